@@ -1,7 +1,17 @@
 #version 450
 
+// Built twice, see SHADER_PERMUTATIONS in src/engine/CMakeLists.txt. BINDLESS
+// builds shader_bindless.frag: every texture lives in one array and the object
+// picks its slot, so materials sharing a pipeline share a draw.
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec2 texCoord;
+layout (location = 2) flat in uint textureIndex;
+layout (location = 3) in vec3 worldNormal;
+layout (location = 4) in float viewDepth;
 
 layout (location = 0) out vec4 outColor;
 
@@ -13,11 +23,35 @@ layout (set = 0, binding = 1) uniform SceneData {
     vec4 sunlightColor;
 } sceneData;
 
+#ifdef BINDLESS
+layout (set = 2, binding = 0) uniform sampler2D textures[];
+#else
 layout (set = 2, binding = 0) uniform sampler2D tex1;
+#endif
+
+// Baked in per material through specialization constants, see ShaderVariant.
+layout (constant_id = 0) const bool FOG = false;
+layout (constant_id = 1) const bool LIGHTING = false;
 
 void main() {
+#ifdef BINDLESS
+    // Instances of one draw may use different textures.
+    vec3 color = texture(textures[nonuniformEXT(textureIndex)], texCoord).xyz;
+#else
     vec3 color = texture(tex1, texCoord).xyz;
+#endif
+
+    if (LIGHTING) {
+        vec3 normal = normalize(worldNormal);
+        float diffuse = max(dot(normal, -sceneData.sunlightDirection.xyz), 0.0);
+        color *= sceneData.ambientColor.rgb + sceneData.sunlightColor.rgb * sceneData.sunlightDirection.w * diffuse;
+    }
+
+    if (FOG) {
+        float range = max(sceneData.fogDistances.y - sceneData.fogDistances.x, 0.0001);
+        float fog = pow(clamp((viewDepth - sceneData.fogDistances.x) / range, 0.0, 1.0), sceneData.fogColor.w);
+        color = mix(color, sceneData.fogColor.rgb, fog);
+    }
 
-    // outColor = vec4(fragColor + sceneData.ambientColor.xyz, 1.0f);
     outColor = vec4(color, 1.0f);
-}
\ No newline at end of file
+}
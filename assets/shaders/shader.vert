@@ -7,6 +7,9 @@ layout (location = 3) in vec2 vTexCoord;
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 texCoord;
+layout (location = 2) flat out uint textureIndex;
+layout (location = 3) out vec3 worldNormal;
+layout (location = 4) out float viewDepth;
 
 layout(set = 0, binding = 0) uniform CameraBuffer {
     mat4 view;
@@ -16,6 +19,7 @@ layout(set = 0, binding = 0) uniform CameraBuffer {
 
 struct ObjectData {
     mat4 model;
+    uint textureIndex;
 };
 
 layout(set = 1, binding = 0) readonly buffer ObjectBuffer {
@@ -28,11 +32,18 @@ layout (push_constant) uniform constants {
 } renderMatrix;
 
 void main() {
-    mat4 modelMatrix = objectBuffer.objects[gl_BaseInstance].model;
-    mat4 transformMatrix = (cameraData.viewproj * modelMatrix);
+    // Instances of a draw are laid out contiguously from firstInstance,
+    // and gl_InstanceIndex already includes that base.
+    mat4 modelMatrix = objectBuffer.objects[gl_InstanceIndex].model;
+    vec4 worldPosition = modelMatrix * vec4(vPosition, 1.0f);
 
-    gl_Position = transformMatrix * vec4(vPosition, 1.0f);
+    gl_Position = cameraData.viewproj * worldPosition;
 
     outColor = vColor;
     texCoord = vTexCoord;
+    textureIndex = objectBuffer.objects[gl_InstanceIndex].textureIndex;
+
+    // For the lighting and fog variants of the fragment shader.
+    worldNormal = mat3(modelMatrix) * vNormal;
+    viewDepth = -(cameraData.view * worldPosition).z;
 }
\ No newline at end of file
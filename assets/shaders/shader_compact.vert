@@ -0,0 +1,59 @@
+#version 460
+
+// Variant of shader.vert for CompactVertex meshes.
+
+layout (location = 0) in vec4 vPosition; // snorm, dequantized by the push constant
+layout (location = 1) in vec2 vNormal;   // octahedral encoded
+layout (location = 2) in vec4 vColor;
+layout (location = 3) in vec2 vTexCoord;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 texCoord;
+layout (location = 2) flat out uint textureIndex;
+layout (location = 3) out vec3 worldNormal;
+layout (location = 4) out float viewDepth;
+
+layout(set = 0, binding = 0) uniform CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} cameraData;
+
+struct ObjectData {
+    mat4 model;
+    uint textureIndex;
+};
+
+layout(set = 1, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+// matrix holds the mesh's dequantization transform.
+layout (push_constant) uniform constants {
+    vec4 data;
+    mat4 matrix;
+} renderMatrix;
+
+// Inverse of the octahedral unfolding in mesh.cpp.
+vec3 OctDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    mat4 modelMatrix = objectBuffer.objects[gl_InstanceIndex].model;
+    vec4 worldPosition = modelMatrix * renderMatrix.matrix * vec4(vPosition.xyz, 1.0f);
+
+    gl_Position = cameraData.viewproj * worldPosition;
+
+    outColor = vColor.rgb;
+    texCoord = vTexCoord;
+    textureIndex = objectBuffer.objects[gl_InstanceIndex].textureIndex;
+
+    // Dequantization only scales and offsets positions, normals come out as encoded.
+    worldNormal = mat3(modelMatrix) * OctDecode(vNormal);
+    viewDepth = -(cameraData.view * worldPosition).z;
+}
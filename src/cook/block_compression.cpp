@@ -0,0 +1,300 @@
+#include "block_compression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace Cook {
+
+    // Line through the block's colors along their principal axis, over the first
+    // channels components. Power iteration on the covariance converges in a few
+    // steps for 16 texels.
+    static void FitLine(const uint8_t texels[64], int channels, float mean[4], float axis[4]) {
+        float min[4], max[4];
+        for (int c = 0; c < channels; c++) {
+            mean[c] = 0.f;
+            min[c] = 255.f;
+            max[c] = 0.f;
+        }
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < channels; c++) {
+                float value = texels[4 * i + c];
+                mean[c] += value / 16.f;
+                min[c] = std::min(min[c], value);
+                max[c] = std::max(max[c], value);
+            }
+        }
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++) {
+            float d[4];
+            for (int c = 0; c < channels; c++) {
+                d[c] = texels[4 * i + c] - mean[c];
+            }
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++) {
+                    covariance[a][b] += d[a] * d[b];
+                }
+            }
+        }
+
+        // Start along the bounding box diagonal, which is already close for most blocks.
+        for (int c = 0; c < channels; c++) {
+            axis[c] = max[c] - min[c];
+        }
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = {};
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++) {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+            }
+
+            float length = 0.f;
+            for (int c = 0; c < channels; c++) {
+                length += next[c] * next[c];
+            }
+            if (length < 1e-12f) break;
+
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; c++) {
+                axis[c] = next[c] / length;
+            }
+        }
+    }
+
+    // Ends of the block's extent along the line, clamped to the representable range.
+    static void FitEndpoints(const uint8_t texels[64], int channels, float start[4], float end[4]) {
+        float mean[4], axis[4];
+        FitLine(texels, channels, mean, axis);
+
+        float lowest = 0.f;
+        float highest = 0.f;
+        for (int i = 0; i < 16; i++) {
+            float t = 0.f;
+            for (int c = 0; c < channels; c++) {
+                t += (texels[4 * i + c] - mean[c]) * axis[c];
+            }
+            lowest = std::min(lowest, t);
+            highest = std::max(highest, t);
+        }
+
+        for (int c = 0; c < channels; c++) {
+            start[c] = std::clamp(mean[c] + axis[c] * lowest, 0.f, 255.f);
+            end[c] = std::clamp(mean[c] + axis[c] * highest, 0.f, 255.f);
+        }
+    }
+
+    static int SquaredDistance(const uint8_t *texel, const int *color, int channels) {
+        int distance = 0;
+        for (int c = 0; c < channels; c++) {
+            int d = texel[c] - color[c];
+            distance += d * d;
+        }
+        return distance;
+    }
+
+    static uint16_t To565(const float color[3]) {
+        int r = std::clamp(static_cast<int>(color[0] * 31.f / 255.f + 0.5f), 0, 31);
+        int g = std::clamp(static_cast<int>(color[1] * 63.f / 255.f + 0.5f), 0, 63);
+        int b = std::clamp(static_cast<int>(color[2] * 31.f / 255.f + 0.5f), 0, 31);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    static void From565(uint16_t packed, int color[3]) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    void CompressBC1(const uint8_t texels[64], uint8_t block[8]) {
+        float start[4], end[4];
+        FitEndpoints(texels, 3, start, end);
+
+        // The outermost texels rarely sit on the line's ends, pulling the endpoints
+        // in by a sixteenth of the range puts more of the palette where texels are.
+        for (int c = 0; c < 3; c++) {
+            float inset = (end[c] - start[c]) / 16.f;
+            start[c] += inset;
+            end[c] -= inset;
+        }
+
+        // color0 > color1 selects the four color mode.
+        uint16_t color0 = To565(end);
+        uint16_t color1 = To565(start);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        int palette[4][3];
+        From565(color0, palette[0]);
+        From565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                int bestDistance = SquaredDistance(&texels[4 * i], palette[0], 3);
+                for (int p = 1; p < 4; p++) {
+                    int distance = SquaredDistance(&texels[4 * i], palette[p], 3);
+                    if (distance < bestDistance) {
+                        best = p;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= static_cast<uint32_t>(best) << (2 * i);
+            }
+        }
+
+        block[0] = static_cast<uint8_t>(color0);
+        block[1] = static_cast<uint8_t>(color0 >> 8);
+        block[2] = static_cast<uint8_t>(color1);
+        block[3] = static_cast<uint8_t>(color1 >> 8);
+        for (int b = 0; b < 4; b++) {
+            block[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+        }
+    }
+
+    void CompressBC3(const uint8_t texels[64], uint8_t block[16]) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; i++) {
+            alpha0 = std::max<int>(alpha0, texels[4 * i + 3]);
+            alpha1 = std::min<int>(alpha1, texels[4 * i + 3]);
+        }
+
+        // alpha0 > alpha1 selects eight interpolated values between them.
+        int palette[8] = {alpha0, alpha1};
+        for (int p = 2; p < 8; p++) {
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+        }
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            for (int i = 0; i < 16; i++) {
+                int alpha = texels[4 * i + 3];
+                int best = 0;
+                for (int p = 1; p < 8; p++) {
+                    if (std::abs(alpha - palette[p]) < std::abs(alpha - palette[best])) {
+                        best = p;
+                    }
+                }
+                indices |= static_cast<uint64_t>(best) << (3 * i);
+            }
+        }
+
+        block[0] = static_cast<uint8_t>(alpha0);
+        block[1] = static_cast<uint8_t>(alpha1);
+        for (int b = 0; b < 6; b++) {
+            block[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+        }
+
+        // BC3 always decodes the color half in four color mode, which BC1 blocks here use anyway.
+        CompressBC1(texels, block + 8);
+    }
+
+    static constexpr int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    // Mode 6 endpoints are 7 bits per channel plus one p-bit shared by the endpoint's
+    // channels, as the lowest bit. Take whichever p-bit lands closer.
+    static void QuantizeEndpoint(const float endpoint[4], int quantized[4], int &pbit) {
+        float bestError = -1.f;
+        for (int p = 0; p < 2; p++) {
+            int candidate[4];
+            float error = 0.f;
+            for (int c = 0; c < 4; c++) {
+                candidate[c] = std::clamp(static_cast<int>((endpoint[c] - p) / 2.f + 0.5f), 0, 127);
+                float d = static_cast<float>((candidate[c] << 1) | p) - endpoint[c];
+                error += d * d;
+            }
+            if (bestError < 0.f || error < bestError) {
+                bestError = error;
+                pbit = p;
+                memcpy(quantized, candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    // Writes fields least significant bit first, in order.
+    struct BitWriter {
+        uint8_t *data;
+        int position = 0;
+
+        void Write(uint32_t value, int bits) {
+            for (int b = 0; b < bits; b++, position++) {
+                if ((value >> b) & 1) {
+                    data[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+                }
+            }
+        }
+    };
+
+    void CompressBC7(const uint8_t texels[64], uint8_t block[16]) {
+        float start[4], end[4];
+        FitEndpoints(texels, 4, start, end);
+
+        int quantized[2][4];
+        int pbits[2];
+        QuantizeEndpoint(start, quantized[0], pbits[0]);
+        QuantizeEndpoint(end, quantized[1], pbits[1]);
+
+        int endpoints[2][4];
+        for (int e = 0; e < 2; e++) {
+            for (int c = 0; c < 4; c++) {
+                endpoints[e][c] = (quantized[e][c] << 1) | pbits[e];
+            }
+        }
+
+        int palette[16][4];
+        for (int p = 0; p < 16; p++) {
+            for (int c = 0; c < 4; c++) {
+                palette[p][c] = ((64 - BC7_WEIGHTS4[p]) * endpoints[0][c] + BC7_WEIGHTS4[p] * endpoints[1][c] + 32) >> 6;
+            }
+        }
+
+        int indices[16];
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestDistance = SquaredDistance(&texels[4 * i], palette[0], 4);
+            for (int p = 1; p < 16; p++) {
+                int distance = SquaredDistance(&texels[4 * i], palette[p], 4);
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices[i] = best;
+        }
+
+        // The first texel's index is stored without its top bit, which must be 0.
+        // Swapping the endpoints mirrors the weights, so the indices flip with them.
+        if (indices[0] & 8) {
+            std::swap(quantized[0], quantized[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (int &index : indices) {
+                index = 15 - index;
+            }
+        }
+
+        memset(block, 0, 16);
+        BitWriter writer {block};
+        writer.Write(1 << 6, 7); // Mode 6: six 0 bits, then a 1
+        for (int c = 0; c < 4; c++) {
+            writer.Write(quantized[0][c], 7);
+            writer.Write(quantized[1][c], 7);
+        }
+        writer.Write(pbits[0], 1);
+        writer.Write(pbits[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++) {
+            writer.Write(indices[i], 4);
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Cook {
+
+    /**
+     * Encoders for one 4x4 block. texels holds the block's 16 RGBA8 texels row by
+     * row, edges of images that aren't a multiple of 4 are padded by the caller.
+     */
+
+    // 8 bytes. Color only, alpha is dropped.
+    void CompressBC1(const uint8_t texels[64], uint8_t block[8]);
+
+    // 16 bytes. Interpolated alpha followed by a BC1 color block.
+    void CompressBC3(const uint8_t texels[64], uint8_t block[16]);
+
+    // 16 bytes, mode 6 only: one RGBA endpoint pair with 16 steps between them.
+    // Well above BC1/BC3 on smooth gradients, for twice BC1's size.
+    void CompressBC7(const uint8_t texels[64], uint8_t block[16]);
+};
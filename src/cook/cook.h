@@ -0,0 +1,10 @@
+#pragma once
+
+namespace Cook {
+
+    enum class CookResult {
+        Cooked,
+        UpToDate,
+        Failed
+    };
+};
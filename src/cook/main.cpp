@@ -0,0 +1,109 @@
+#include "mesh_cooker.h"
+#include "texture_cooker.h"
+#include "shader_pack.h"
+#include "thread_pool.h"
+#include "logging.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Packs compiled shaders into the one file Engine::LoadShaderModule reads from,
+// each named after its .spv file without the extension. Run by the Shaders target.
+static int PackShaders(const std::string &output, const std::vector<std::string> &inputs) {
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> shaders;
+    for (const std::string &input : inputs) {
+        std::ifstream file(input, std::ios::binary);
+        if (!file) {
+            LOGE("Failed to read shader {}", input);
+            return 1;
+        }
+
+        std::filesystem::path path {input};
+        std::string name = path.extension() == ".spv" ? path.stem().string() : path.filename().string();
+        shaders.emplace_back(name, std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {}));
+    }
+
+    if (!Graphics::WriteShaderPack(output, shaders)) {
+        LOGE("Failed to write shader pack {}", output);
+        return 1;
+    }
+
+    LOGI("Packed {} shaders into {}", shaders.size(), output);
+    return 0;
+}
+
+// Cooks the raw assets tree into the caches the engine loads without decoding or
+// importing anything: vertex cache optimized meshes in every vertex format, and
+// block compressed textures with their whole mip chain. Outputs go next to their
+// sources, so run it on the assets directory okapi runs with.
+int main(int argc, char* args[]) {
+    // [directory]  assets to cook, defaults to ./assets
+    // --force      cook everything, even outputs that are up to date
+    // --bc7        compress every texture as BC7 instead of BC1/BC3
+    //
+    // --pack-shaders <output> <spv...>  only pack compiled shaders, see PackShaders
+    if (argc >= 3 && strcmp(args[1], "--pack-shaders") == 0) {
+        return PackShaders(args[2], std::vector<std::string>(args + 3, args + argc));
+    }
+
+    std::string root = "assets";
+    bool force = false;
+    Cook::TextureCodec codec = Cook::TextureCodec::Auto;
+    for(int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "--force") == 0) {
+            force = true;
+        } else if (strcmp(args[i], "--bc7") == 0) {
+            codec = Cook::TextureCodec::BC7;
+        } else {
+            root = args[i];
+        }
+    }
+
+    std::error_code error;
+    if (!std::filesystem::is_directory(root, error)) {
+        LOGE("{} is not a directory", root);
+        return 1;
+    }
+
+    std::vector<std::string> meshes;
+    std::vector<std::string> textures;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(root, error)) {
+        if (!entry.is_regular_file()) continue;
+
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        if (extension == ".obj") {
+            meshes.push_back(entry.path().generic_string());
+        } else if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp") {
+            textures.push_back(entry.path().generic_string());
+        }
+    }
+
+    // One job per file. Large ones spread their own work over the pool as well,
+    // the calling thread helps, so every core is busy.
+    Jobs::ThreadPool jobs;
+    std::atomic<uint32_t> cooked {0};
+    std::atomic<uint32_t> upToDate {0};
+    std::atomic<uint32_t> failed {0};
+
+    jobs.ParallelFor(meshes.size() + textures.size(), [&](size_t i) {
+        Cook::CookResult result = i < meshes.size()
+            ? Cook::CookMesh(meshes[i], force, jobs)
+            : Cook::CookTexture(textures[i - meshes.size()], codec, force, jobs);
+
+        switch (result) {
+            case Cook::CookResult::Cooked: cooked++; break;
+            case Cook::CookResult::UpToDate: upToDate++; break;
+            case Cook::CookResult::Failed: failed++; break;
+        }
+    });
+
+    LOGI("Cooked {} assets, {} up to date, {} failed", cooked.load(), upToDate.load(), failed.load());
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+#include "mesh_cooker.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "logging.h"
+#include <vector>
+
+namespace Cook {
+
+    CookResult CookMesh(const std::string &path, bool force, Jobs::ThreadPool &jobs) {
+        const Graphics::VertexFormat formats[] = {Graphics::VertexFormat::Full, Graphics::VertexFormat::Compact};
+
+        // Caches the engine wrote on import are current too, but not optimized.
+        if (!force) {
+            bool upToDate = true;
+            for (Graphics::VertexFormat format : formats) {
+                IO::MappedFile file;
+                Graphics::MeshCacheView cached;
+                upToDate = upToDate && Graphics::LoadMeshCache(path, format, file, cached) && cached.cooked;
+            }
+            if (upToDate) return CookResult::UpToDate;
+        }
+
+        auto [result, mesh] = Graphics::Mesh::FromObj(jobs, path);
+        if (!result) return CookResult::Failed;
+
+        mesh.OptimizeVertexCache();
+
+        // Compact keeps the full vertices around, so one import serves both formats.
+        std::vector<uint16_t> shortIndices;
+        mesh.PrepareIndices(shortIndices);
+        bool written = Graphics::WriteMeshCache(path, mesh, true);
+
+        mesh.Compact();
+        mesh.PrepareIndices(shortIndices);
+        written = written && Graphics::WriteMeshCache(path, mesh, true);
+
+        if (!written) {
+            LOGW("Failed to write mesh cache for {}", path);
+            return CookResult::Failed;
+        }
+
+        LOGI("Cooked {}: {} vertices, {} triangles", path, mesh.vertices.size(), mesh.GetIndexCount() / 3);
+        return CookResult::Cooked;
+    }
+}
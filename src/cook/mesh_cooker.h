@@ -0,0 +1,15 @@
+#pragma once
+
+#include "cook.h"
+#include "thread_pool.h"
+#include <string>
+
+namespace Cook {
+
+    /**
+     * Import the OBJ at path, optimize it for the vertex cache and write a mesh
+     * cache for every vertex format. Skipped when cooked caches are current,
+     * unless force is set.
+     */
+    CookResult CookMesh(const std::string &path, bool force, Jobs::ThreadPool &jobs);
+};
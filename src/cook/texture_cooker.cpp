@@ -0,0 +1,166 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "texture_cooker.h"
+#include "block_compression.h"
+#include "texture_cache.h"
+#include "logging.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace Cook {
+
+    // Compression jobs are this many rows of blocks.
+    static constexpr uint32_t BLOCK_ROWS_PER_JOB = 16;
+
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint8_t> pixels; // RGBA8, sRGB color
+    };
+
+    static const std::array<float, 256> &GetSrgbToLinear() {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> values;
+            for (size_t i = 0; i < values.size(); i++) {
+                float c = i / 255.f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    static uint8_t LinearToSrgb(float linear) {
+        float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+    }
+
+    // Same filter as mip.comp: each texel averages a 2x2 quad of the level above
+    // in linear space, odd sizes repeat their last row or column.
+    static Level Downsample(const Level &src) {
+        const std::array<float, 256> &toLinear = GetSrgbToLinear();
+
+        Level dst;
+        dst.width = std::max(src.width / 2, 1u);
+        dst.height = std::max(src.height / 2, 1u);
+        dst.pixels.resize(size_t(dst.width) * dst.height * 4);
+
+        for (uint32_t y = 0; y < dst.height; y++) {
+            for (uint32_t x = 0; x < dst.width; x++) {
+                float sum[4] = {};
+                for (uint32_t dy = 0; dy < 2; dy++) {
+                    for (uint32_t dx = 0; dx < 2; dx++) {
+                        uint32_t sx = std::min(2 * x + dx, src.width - 1);
+                        uint32_t sy = std::min(2 * y + dy, src.height - 1);
+                        const uint8_t *texel = &src.pixels[4 * (size_t(sy) * src.width + sx)];
+                        for (int c = 0; c < 3; c++) {
+                            sum[c] += toLinear[texel[c]];
+                        }
+                        sum[3] += texel[3] / 255.f;
+                    }
+                }
+
+                uint8_t *out = &dst.pixels[4 * (size_t(y) * dst.width + x)];
+                for (int c = 0; c < 3; c++) {
+                    out[c] = LinearToSrgb(sum[c] / 4.f);
+                }
+                out[3] = static_cast<uint8_t>(std::clamp(sum[3] / 4.f * 255.f + 0.5f, 0.f, 255.f));
+            }
+        }
+        return dst;
+    }
+
+    static std::vector<uint8_t> CompressLevel(const Level &level, vk::Format format, Jobs::ThreadPool &jobs) {
+        uint32_t blocksWide = (level.width + 3) / 4;
+        uint32_t blocksHigh = (level.height + 3) / 4;
+        size_t blockSize = format == vk::Format::eBc1RgbSrgbBlock ? 8 : 16;
+        std::vector<uint8_t> data(size_t(blocksWide) * blocksHigh * blockSize);
+
+        size_t jobCount = (blocksHigh + BLOCK_ROWS_PER_JOB - 1) / BLOCK_ROWS_PER_JOB;
+        jobs.ParallelFor(jobCount, [&](size_t job) {
+            uint32_t firstRow = static_cast<uint32_t>(job) * BLOCK_ROWS_PER_JOB;
+            uint32_t lastRow = std::min(firstRow + BLOCK_ROWS_PER_JOB, blocksHigh);
+
+            uint8_t texels[64];
+            for (uint32_t by = firstRow; by < lastRow; by++) {
+                for (uint32_t bx = 0; bx < blocksWide; bx++) {
+                    // Blocks over the edge repeat the last row or column, which
+                    // the sampler never reads but the endpoint fit sees.
+                    for (uint32_t ty = 0; ty < 4; ty++) {
+                        for (uint32_t tx = 0; tx < 4; tx++) {
+                            uint32_t x = std::min(bx * 4 + tx, level.width - 1);
+                            uint32_t y = std::min(by * 4 + ty, level.height - 1);
+                            memcpy(&texels[4 * (ty * 4 + tx)], &level.pixels[4 * (size_t(y) * level.width + x)], 4);
+                        }
+                    }
+
+                    uint8_t *block = &data[(size_t(by) * blocksWide + bx) * blockSize];
+                    if (format == vk::Format::eBc1RgbSrgbBlock) {
+                        CompressBC1(texels, block);
+                    } else if (format == vk::Format::eBc3SrgbBlock) {
+                        CompressBC3(texels, block);
+                    } else {
+                        CompressBC7(texels, block);
+                    }
+                }
+            }
+        });
+
+        return data;
+    }
+
+    CookResult CookTexture(const std::string &path, TextureCodec codec, bool force, Jobs::ThreadPool &jobs) {
+        // Auto picks between BC1 and BC3 from the pixels, either is current for it.
+        if (!force) {
+            IO::MappedFile file;
+            Graphics::TextureCacheView cached;
+            if (Graphics::LoadTextureCache(path, file, cached) &&
+                (cached.format == vk::Format::eBc7SrgbBlock) == (codec == TextureCodec::BC7)) {
+                return CookResult::UpToDate;
+            }
+        }
+
+        int width, height, channels;
+        stbi_uc* decoded = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!decoded) {
+            LOGW("Failed to load texture {}", path);
+            return CookResult::Failed;
+        }
+
+        Level level;
+        level.width = static_cast<uint32_t>(width);
+        level.height = static_cast<uint32_t>(height);
+        level.pixels.assign(decoded, decoded + size_t(width) * height * 4);
+        stbi_image_free(decoded);
+
+        vk::Format format = vk::Format::eBc7SrgbBlock;
+        if (codec == TextureCodec::Auto) {
+            bool opaque = true;
+            for (size_t i = 3; i < level.pixels.size() && opaque; i += 4) {
+                opaque = level.pixels[i] == 255;
+            }
+            format = opaque ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc3SrgbBlock;
+        }
+
+        // Every level is filtered from the uncompressed one above it, down to 1x1.
+        std::vector<std::vector<uint8_t>> levels;
+        while (true) {
+            levels.push_back(CompressLevel(level, format, jobs));
+            if (level.width == 1 && level.height == 1) break;
+            level = Downsample(level);
+        }
+
+        vk::Extent3D extent {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+        if (!Graphics::WriteTextureCache(path, format, extent, levels)) {
+            LOGW("Failed to write texture cache for {}", path);
+            return CookResult::Failed;
+        }
+
+        LOGI("Cooked {}: {}x{}, {} levels of {}", path, width, height, levels.size(), vk::to_string(format));
+        return CookResult::Cooked;
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "cook.h"
+#include "thread_pool.h"
+#include <string>
+
+namespace Cook {
+
+    enum class TextureCodec {
+        // BC1 for opaque images, BC3 when any texel has alpha.
+        Auto,
+        // BC7 mode 6 for everything.
+        BC7
+    };
+
+    /**
+     * Decode the image at path, build its full mip chain and write it block
+     * compressed to its texture cache. Skipped when the cache is current and in
+     * the format codec would produce, unless force is set.
+     */
+    CookResult CookTexture(const std::string &path, TextureCodec codec, bool force, Jobs::ThreadPool &jobs);
+};
@@ -0,0 +1,130 @@
+#include "culling.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OKAPI_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Graphics {
+
+    Frustum ExtractFrustum(const glm::mat4 &viewProj) {
+        // glm is column major, gather the rows of the matrix.
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4 {viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]};
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // Left
+        frustum.planes[1] = rows[3] - rows[0]; // Right
+        frustum.planes[2] = rows[3] + rows[1]; // Bottom
+        frustum.planes[3] = rows[3] - rows[1]; // Top
+        frustum.planes[4] = rows[3] + rows[2]; // Near
+        frustum.planes[5] = rows[3] - rows[2]; // Far
+
+        // Normalize so plane distances are in world units and can be compared to radii.
+        for(auto &plane : frustum.planes) {
+            plane /= glm::length(glm::vec3 {plane});
+        }
+
+        return frustum;
+    }
+
+    void SphereBatch::Clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        radius.clear();
+    }
+
+    void SphereBatch::Push(const glm::mat4 &model, const glm::vec4 &sphere) {
+        glm::vec4 center = model * glm::vec4 {glm::vec3 {sphere}, 1.f};
+        float scale = std::sqrt(std::max({
+            glm::dot(glm::vec3 {model[0]}, glm::vec3 {model[0]}),
+            glm::dot(glm::vec3 {model[1]}, glm::vec3 {model[1]}),
+            glm::dot(glm::vec3 {model[2]}, glm::vec3 {model[2]})
+        }));
+
+        x.push_back(center.x);
+        y.push_back(center.y);
+        z.push_back(center.z);
+        radius.push_back(sphere.w * scale);
+    }
+
+    static bool SphereVisible(const Frustum &frustum, float x, float y, float z, float r) {
+        for(const auto &plane : frustum.planes) {
+            if (plane.x * x + plane.y * y + plane.z * z + plane.w < -r) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CullSpheres(const Frustum &frustum, const SphereBatch &spheres, std::vector<uint32_t> &visible) {
+        size_t count = spheres.Size();
+        const float *xs = spheres.x.data();
+        const float *ys = spheres.y.data();
+        const float *zs = spheres.z.data();
+        const float *rs = spheres.radius.data();
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        // Eight spheres per iteration against all planes, survivors read off the sign mask.
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(xs + i);
+            __m256 y = _mm256_loadu_ps(ys + i);
+            __m256 z = _mm256_loadu_ps(zs + i);
+            __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(rs + i));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const auto &plane : frustum.planes) {
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_set1_ps(plane.w));
+                d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.y), y), d);
+                d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z), d);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            for (uint32_t lane = 0; lane < 8; lane++) {
+                if (mask & (1 << lane)) {
+                    visible.push_back(static_cast<uint32_t>(i) + lane);
+                }
+            }
+        }
+#elif defined(OKAPI_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(xs + i);
+            __m128 y = _mm_loadu_ps(ys + i);
+            __m128 z = _mm_loadu_ps(zs + i);
+            __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(rs + i));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const auto &plane : frustum.planes) {
+                __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_set1_ps(plane.w));
+                d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.y), y), d);
+                d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), d);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                if (mask & (1 << lane)) {
+                    visible.push_back(static_cast<uint32_t>(i) + lane);
+                }
+            }
+        }
+#endif
+
+        // Scalar tail, and everything when no SIMD path is compiled in.
+        for (; i < count; i++) {
+            if (SphereVisible(frustum, xs[i], ys[i], zs[i], rs[i])) {
+                visible.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <vector>
+#include <stdint.h>
+
+namespace Graphics {
+
+    /**
+     * Six planes bounding the view volume, normals pointing inward.
+     * A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+     */
+    struct Frustum {
+        glm::vec4 planes[6];
+    };
+
+    /**
+     * Extract the frustum planes from a view projection matrix (Gribb/Hartmann).
+     * The near plane is taken in GL clip space, which is what glm produces and is
+     * slightly looser than Vulkan's, so culling stays conservative.
+     */
+    Frustum ExtractFrustum(const glm::mat4 &viewProj);
+
+    /**
+     * World space bounding spheres stored as separate arrays so they can be
+     * tested several at a time.
+     */
+    struct SphereBatch {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> radius;
+
+        void Clear();
+        size_t Size() const { return x.size(); }
+
+        /**
+         * Transform an object space sphere (xyz center, w radius) into world space
+         * and append it. The radius is scaled by the largest axis scale of model.
+         */
+        void Push(const glm::mat4 &model, const glm::vec4 &sphere);
+    };
+
+    /**
+     * Append the index of every sphere at least partially inside the frustum to
+     * visible, in increasing order. Uses AVX2 or SSE2 when compiled in.
+     */
+    void CullSpheres(const Frustum &frustum, const SphereBatch &spheres, std::vector<uint32_t> &visible);
+};
@@ -0,0 +1,111 @@
+#include "descriptor_allocator.h"
+#include "logging.h"
+#include <algorithm>
+#include <cassert>
+
+namespace Graphics {
+
+    // Pools grow by half each time one runs out, up to this many sets.
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    void DescriptorAllocator::Init(vk::Device device, uint32_t setsPerPool, const std::vector<PoolSizeRatio> &ratios, bool freeable) {
+        _device = device;
+        _setsPerPool = setsPerPool;
+        _ratios = ratios;
+        _freeable = freeable;
+    }
+
+    void DescriptorAllocator::Destroy() {
+        for (vk::DescriptorPool pool : _readyPools) {
+            _device.destroyDescriptorPool(pool);
+        }
+        for (vk::DescriptorPool pool : _fullPools) {
+            _device.destroyDescriptorPool(pool);
+        }
+        _readyPools.clear();
+        _fullPools.clear();
+        _setPools.clear();
+    }
+
+    vk::DescriptorPool DescriptorAllocator::GetPool() {
+        if (!_readyPools.empty()) return _readyPools.back();
+
+        std::vector<vk::DescriptorPoolSize> sizes;
+        for (const PoolSizeRatio &ratio : _ratios) {
+            uint32_t count = std::max(1u, static_cast<uint32_t>(ratio.ratio * _setsPerPool));
+            sizes.push_back({ratio.type, count});
+        }
+
+        vk::DescriptorPoolCreateFlags flags {};
+        if (_freeable) {
+            flags |= vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+        }
+
+        auto [result, pool] = _device.createDescriptorPool({flags, _setsPerPool, sizes});
+        VK_CHECK(result);
+
+        _setsPerPool = std::min(_setsPerPool + _setsPerPool / 2, MAX_SETS_PER_POOL);
+        _readyPools.push_back(pool);
+        return pool;
+    }
+
+    vk::DescriptorSet DescriptorAllocator::Allocate(vk::DescriptorSetLayout layout) {
+        while (true) {
+            bool fresh = _readyPools.empty();
+            vk::DescriptorPool pool = GetPool();
+
+            auto [result, sets] = _device.allocateDescriptorSets({pool, layout});
+            if (result == vk::Result::eSuccess) {
+                if (_freeable) {
+                    _setPools[static_cast<VkDescriptorSet>(sets[0])] = pool;
+                }
+                return sets[0];
+            }
+
+            // Out of room. Ready pools may be partly used ones Free gave back, so retire
+            // each that fails until GetPool runs out of them and creates a fresh one.
+            // A fresh pool that can't fit the set never will, bigger ones have the same ratios.
+            if (!fresh && (result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool)) {
+                _readyPools.pop_back();
+                _fullPools.push_back(pool);
+                continue;
+            }
+
+            LOGE("Failed to allocate a descriptor set: {}", vk::to_string(result));
+            return {};
+        }
+    }
+
+    void DescriptorAllocator::Free(vk::DescriptorSet set) {
+        assert(_freeable);
+
+        auto it = _setPools.find(static_cast<VkDescriptorSet>(set));
+        if (it == _setPools.end()) {
+            LOGW("Freeing a descriptor set the allocator doesn't own");
+            return;
+        }
+
+        vk::DescriptorPool pool = it->second;
+        _setPools.erase(it);
+        VK_CHECK(_device.freeDescriptorSets(pool, set));
+
+        // It has room again.
+        auto full = std::find(_fullPools.begin(), _fullPools.end(), pool);
+        if (full != _fullPools.end()) {
+            _fullPools.erase(full);
+            _readyPools.insert(_readyPools.begin(), pool);
+        }
+    }
+
+    void DescriptorAllocator::Reset() {
+        for (vk::DescriptorPool pool : _fullPools) {
+            _readyPools.push_back(pool);
+        }
+        _fullPools.clear();
+
+        for (vk::DescriptorPool pool : _readyPools) {
+            VK_CHECK(_device.resetDescriptorPool(pool));
+        }
+        _setPools.clear();
+    }
+}
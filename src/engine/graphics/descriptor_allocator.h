@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vulkan.h"
+#include <unordered_map>
+#include <vector>
+
+namespace Graphics {
+
+    /**
+     * Hands out descriptor sets from a list of pools, creating a bigger pool whenever
+     * the ones it has run out. Pools are sized from per-set ratios, so each holds its
+     * set count worth of the expected mix of descriptor types.
+     *
+     * Freeable allocators return sets one at a time. Transient ones, such as a frame's,
+     * never free sets and Reset every pool at once when nothing uses them anymore.
+     */
+    class DescriptorAllocator {
+
+    public:
+        struct PoolSizeRatio {
+            vk::DescriptorType type;
+            float ratio; // Descriptors of type per set
+        };
+
+        void Init(vk::Device device, uint32_t setsPerPool, const std::vector<PoolSizeRatio> &ratios, bool freeable);
+        void Destroy();
+
+        /**
+         * Set for layout from the first pool with room, or a new pool. Null, with an
+         * error logged, if even a new pool can't hold it.
+         */
+        vk::DescriptorSet Allocate(vk::DescriptorSetLayout layout);
+
+        /**
+         * Give set back to its pool. Freeable allocators only.
+         */
+        void Free(vk::DescriptorSet set);
+
+        /**
+         * Reset every pool, which frees all sets allocated from them.
+         */
+        void Reset();
+
+        size_t GetPoolCount() const { return _readyPools.size() + _fullPools.size(); }
+
+    private:
+        vk::DescriptorPool GetPool();
+
+        vk::Device _device;
+        std::vector<PoolSizeRatio> _ratios;
+        uint32_t _setsPerPool = 0;
+        bool _freeable = false;
+
+        // Pools with room left, allocated from back to front. Pools that ran out wait
+        // in _fullPools until a Reset, or a Free for freeable allocators.
+        std::vector<vk::DescriptorPool> _readyPools;
+        std::vector<vk::DescriptorPool> _fullPools;
+
+        // Pool each live set came from, so it can be freed.
+        std::unordered_map<VkDescriptorSet, vk::DescriptorPool> _setPools;
+    };
+}
@@ -0,0 +1,69 @@
+#include "frame_allocator.h"
+#include "logging.h"
+
+namespace Graphics {
+
+    void FrameAllocator::Init(vma::Allocator allocator, size_t regionSize, uint32_t regionCount, size_t alignment) {
+        _allocator = allocator;
+        _alignment = alignment > 0 ? alignment : 1;
+
+        // Keep every region start aligned so offsets stay valid for any region.
+        _regionSize = (regionSize + _alignment - 1) & ~(_alignment - 1);
+
+        vk::BufferCreateInfo bufferCreateInfo {};
+        bufferCreateInfo.size = _regionSize * regionCount;
+        bufferCreateInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+        bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+        // Sequential write without AllowTransferInstead guarantees host visible memory,
+        // so writes never go through a staging copy.
+        vma::AllocationCreateInfo allocationCreateInfo {};
+        allocationCreateInfo.flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite |
+                                     vma::AllocationCreateFlagBits::eMapped;
+        allocationCreateInfo.usage = vma::MemoryUsage::eAuto;
+
+        VK_CHECK(_allocator.createBuffer(
+            &bufferCreateInfo,
+            &allocationCreateInfo,
+            &buffer.buffer,
+            &buffer.allocation,
+            &buffer.allocInfo
+        ));
+
+        _regionStart = 0;
+        _head = 0;
+    }
+
+    void FrameAllocator::Destroy() {
+        _allocator.destroyBuffer(buffer.buffer, buffer.allocation);
+        buffer = {};
+    }
+
+    void FrameAllocator::Reset(uint32_t frameIndex) {
+        _regionStart = _regionSize * frameIndex;
+        _head = _regionStart;
+    }
+
+    FrameAllocation FrameAllocator::Allocate(size_t size) {
+        size_t offset = (_head + _alignment - 1) & ~(_alignment - 1);
+
+        if (offset + size > _regionStart + _regionSize) {
+            LOGE("Frame allocator out of memory ({} of {} bytes used)", GetUsed(), _regionSize);
+            return {};
+        }
+
+        _head = offset + size;
+
+        FrameAllocation allocation;
+        allocation.data = reinterpret_cast<char *>(buffer.allocInfo.pMappedData) + offset;
+        allocation.offset = static_cast<uint32_t>(offset);
+        return allocation;
+    }
+
+    void FrameAllocator::Flush() {
+        if (_head == _regionStart) return;
+
+        // No-op on HOST_COHERENT memory.
+        VK_CHECK(_allocator.flushAllocation(buffer.allocation, _regionStart, _head - _regionStart));
+    }
+}
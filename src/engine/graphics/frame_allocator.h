@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vulkan.h"
+#include "types.h"
+#include <cstring>
+
+namespace Graphics {
+
+    struct FrameAllocation {
+        // Persistently mapped pointer to write the data through.
+        void *data = nullptr;
+
+        // Offset into FrameAllocator::buffer, used as a dynamic descriptor offset.
+        uint32_t offset = 0;
+    };
+
+    /**
+     * Linear allocator for data that only lives for one frame, e.g. uniforms.
+     * One persistently mapped buffer is split into a region per frame in flight,
+     * allocations bump a head pointer and the whole region is recycled once the
+     * frame's fence has signaled. The used range is flushed once per frame.
+     */
+    class FrameAllocator {
+
+    public:
+        AllocatedBuffer buffer;
+
+        void Init(vma::Allocator allocator, size_t regionSize, uint32_t regionCount, size_t alignment);
+        void Destroy();
+
+        /**
+         * Start allocating from the region belonging to frameIndex, discarding its old contents.
+         */
+        void Reset(uint32_t frameIndex);
+
+        /**
+         * Returns an aligned sub-range of the current region. data is null if the region is full.
+         */
+        FrameAllocation Allocate(size_t size);
+
+        /**
+         * Make everything allocated since Reset visible to the device.
+         */
+        void Flush();
+
+        template<typename T>
+        FrameAllocation Push(const T &value) {
+            FrameAllocation allocation = Allocate(sizeof(T));
+            if (allocation.data) {
+                memcpy(allocation.data, &value, sizeof(T));
+            }
+            return allocation;
+        }
+
+        size_t GetRegionSize() const { return _regionSize; }
+        size_t GetUsed() const { return _head - _regionStart; }
+
+    private:
+        vma::Allocator _allocator;
+        size_t _regionSize = 0;
+        size_t _alignment = 1;
+        size_t _regionStart = 0;
+        size_t _head = 0;
+    };
+};
@@ -5,12 +5,18 @@
 #include "logging.h"
 #include "types.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "pipeline.h"
+#include "pipeline_cache.h"
 #include "texture.h"
+#include "texture_cache.h"
 #include "renderable.h"
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <iostream>
 #include <set>
+#include <limits>
 #include <SDL2/SDL_vulkan.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
@@ -23,22 +29,43 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 #endif
 
 namespace Graphics {
-    Engine::Engine() { Init(); }
+    Engine::Engine(EngineConfig config) : jobs{config.workerThreads}, _config{config} { Init(); }
 
     Engine::~Engine() {
         CloseVulkan();
-        SDL_DestroyWindow(window);
+        if (window) {
+            SDL_DestroyWindow(window);
+        }
         SDL_Quit();
     }
 
     void Engine::CloseVulkan() {
         VK_CHECK(_device.waitIdle());
 
+        CloseStreaming();
+
+        // Let workers finish compiling, nothing waits on the pipelines anymore.
+        {
+            std::unique_lock<std::mutex> lock {_pipelineMutex};
+            _pipelineCompiled.wait(lock, [this]() { return _compilingCount == 0; });
+        }
+        PollPipelines();
+
         // Destroy GUI
-        _device.destroyDescriptorPool(_imguiPool);
-        ImGui_ImplVulkan_Shutdown();
+        if (_imguiPool) {
+            _device.destroyDescriptorPool(_imguiPool);
+            ImGui_ImplVulkan_Shutdown();
+        }
+
+        // The device is idle, nothing uses evicted resources anymore.
+        for (auto &[frame, release] : _retiredResources) {
+            release();
+        }
+        _retiredResources.clear();
 
+        // Loading, failed and evicted assets share the placeholder's resources.
         for(auto &texture : _textures) {
+            if (texture.second.state != AssetState::Resident) continue;
             _allocator.destroyImage(texture.second.image.image, texture.second.image.allocation);
             _device.destroyImageView(texture.second.imageView);
             _device.destroySampler(texture.second.sampler);
@@ -46,16 +73,19 @@ namespace Graphics {
         _textures.clear();
 
         for(auto &mesh : _meshes) {
+            if (mesh.second.state != AssetState::Resident) continue;
             _allocator.destroyBuffer(mesh.second.vertexBuffer.buffer, mesh.second.vertexBuffer.allocation);
+            _allocator.destroyBuffer(mesh.second.indexBuffer.buffer, mesh.second.indexBuffer.allocation);
             mesh.second.Destroy();
         }
         _meshes.clear();
 
-        _allocator.destroyBuffer(sceneParamsBuffer.buffer, sceneParamsBuffer.allocation);
+        frameAllocator.Destroy();
 
-        _allocator.destroyImage(_depthImage.image, _depthImage.allocation);
-
-        _device.destroyImageView(_depthImageView);
+        for(auto &image : _offscreenImages) {
+            _allocator.destroyImage(image.image, image.allocation);
+        }
+        _offscreenImages.clear();
 
         TeardownFramebuffers();
         for(auto &perframe: _perframes) {
@@ -64,29 +94,53 @@ namespace Graphics {
 
         _perframes.clear();
 
+        DestroyBuffer(_sceneObjectBuffer);
+
+        _uploadContext.Destroy();
+        _transferContext.Destroy();
+
         _allocator.destroy();
         _allocator = nullptr;
 
-        for(auto semaphore: _recycledSemaphores) {
-            _device.destroySemaphore(semaphore);
-        }
+        _pipelineRegistry.Destroy();
+        _device.destroyPipelineLayout(_pipelineLayout);
 
-        _device.destroyPipeline(_pipeline);
+        _device.destroyPipeline(_cullPipeline);
+        _device.destroyPipelineLayout(_cullPipelineLayout);
 
-        _device.destroyPipelineLayout(_pipelineLayout);
+        _device.destroyPipeline(_mipPipeline);
+        _device.destroyPipelineLayout(_mipPipelineLayout);
+        _device.destroySampler(_mipSampler);
 
         _device.destroyRenderPass(_renderPass);
 
-        _uploadContext.Destroy();
+        for (auto &[path, module] : _shaderModules) {
+            _device.destroyShaderModule(module);
+        }
+        _shaderModules.clear();
+
+        _retiredDescriptorSets.clear();
 
-        _device.destroyDescriptorPool(_descriptorPool);
+        _device.destroyDescriptorUpdateTemplate(_textureUpdateTemplate);
+        _device.destroyDescriptorUpdateTemplate(_objectUpdateTemplate);
+        _device.destroyDescriptorUpdateTemplate(_cullUpdateTemplate);
+
+        _descriptorAllocator.Destroy();
+        _device.destroyDescriptorPool(_bindlessPool);
         _device.destroyDescriptorSetLayout(_singleTextureSetLayout);
+        _device.destroyDescriptorSetLayout(_bindlessSetLayout);
+        _device.destroyDescriptorSetLayout(_cullSetLayout);
+        _device.destroyDescriptorSetLayout(_mipSetLayout);
         _device.destroyDescriptorSetLayout(_objectSetLayout);
         _device.destroyDescriptorSetLayout(_globalSetLayout);
 
         for(auto imageView : _swapchainImageViews) {
             _device.destroyImageView(imageView);
         }
+        for(auto semaphore : _swapchainReleaseSemaphores) {
+            _device.destroySemaphore(semaphore);
+        }
+        _swapchainReleaseSemaphores.clear();
 
         _device.destroySwapchainKHR(_swapchain);
         _swapchain = nullptr;
@@ -94,6 +148,12 @@ namespace Graphics {
         _instance.destroySurfaceKHR(_surface);
         _surface = nullptr;
 
+        // Holds every pipeline built this run by now.
+        if (!_config.pipelineCachePath.empty() && !SavePipelineCache(_device, _pipelineCache, _config.pipelineCachePath)) {
+            LOGW("Failed to write pipeline cache {}", _config.pipelineCachePath);
+        }
+        _device.destroyPipelineCache(_pipelineCache);
+
         _device.destroy();
         _device = nullptr;
 
@@ -106,33 +166,50 @@ namespace Graphics {
     }
 
     void Engine::Init() {
-        // Init SDL
-        if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
+        // Init SDL. Headless runs only need events and timers, no video subsystem.
+        Uint32 sdlFlags = _config.headless ? SDL_INIT_EVENTS | SDL_INIT_TIMER : SDL_INIT_EVERYTHING;
+        if (SDL_Init(sdlFlags) < 0) {
             LOGE("Could not intialize sdl2: {}", SDL_GetError());
         }
 
-        window = SDL_CreateWindow(
-            "Okapi",
-            SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-            SCREEN_WIDTH, SCREEN_HEIGHT,
-            SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE
-        );
+        window = nullptr;
+        if (!_config.headless) {
+            window = SDL_CreateWindow(
+                "Okapi",
+                SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                SCREEN_WIDTH, SCREEN_HEIGHT,
+                SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE
+            );
 
-        if (window == NULL) {
-            fprintf(stderr, "Could not create window: %s\n", SDL_GetError());
-            assert(0);
+            if (window == NULL) {
+                fprintf(stderr, "Could not create window: %s\n", SDL_GetError());
+                assert(0);
+            }
         }
 
         InitVulkan();
-        InitGui();
+
+        // ImGui is driven by the SDL window, so there is nothing to draw it into when headless.
+        if (!_config.headless) {
+            InitGui();
+        }
     }
 
     void Engine::InitVulkan() {
         CreateDispatcher();
 
+        // Let SDL report the surface extensions for whatever platform we are on.
+        std::vector<const char *> instanceExtensions;
+        if (!_config.headless) {
+            unsigned int extensionCount = 0;
+            SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr);
+            instanceExtensions.resize(extensionCount);
+            SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, instanceExtensions.data());
+        }
+
         InitVkInstance(
-            { "VK_LAYER_KHRONOS_validation" },
-            { VK_KHR_SURFACE_EXTENSION_NAME }
+            gEnableValidationLayers ? gValidationLayers : std::vector<const char *>{},
+            instanceExtensions
         );
 
     #ifndef NDEBUG
@@ -140,15 +217,34 @@ namespace Graphics {
     #endif
 
         InitPhysicalDeviceAndSurface();
-        InitLogicalDevice({ VK_KHR_SWAPCHAIN_EXTENSION_NAME });
+        if (_config.headless) {
+            InitLogicalDevice({});
+        } else {
+            InitLogicalDevice(gDeviceExtensions);
+        }
         InitAllocator();
-        InitSwapchain();
+        InitPerframes();
+        if (_config.headless) {
+            InitOffscreenTargets();
+        } else {
+            InitSwapchain();
+        }
         InitRenderPass();
-        InitSceneBuffer();
+        InitFrameAllocator();
         InitDescriptorSetLayouts();
+        InitDescriptorUpdateTemplates();
+        InitSceneObjectBuffer(std::max<size_t>(1, _config.initialObjectCapacity));
         InitDescriptors();
         InitUploadContext();
+        InitPlaceholders();
+        _pipelineCache = LoadPipelineCache(_device, _physicalDeviceProperties, _config.pipelineCachePath);
+        _pipelineRegistry.Init(_device, _renderPass, _pipelineCache);
+        if (!LoadShaderPack(_config.shaderPackPath, _shaderPackFile, _shaderPack)) {
+            LOGW("No shader pack at {}, loading shaders from .spv files", _config.shaderPackPath);
+        }
         InitPipeline();
+        InitCullPipeline();
+        InitMipPipeline();
         InitFramebuffers();
     }
 
@@ -168,14 +264,6 @@ namespace Graphics {
         activeInstanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     #endif
 
-    #ifdef VK_USE_PLATFORM_WIN32_KHR
-        activeInstanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-    #elif defined(VK_USE_PLATFORM_MACOS_KHR)
-        activeInstanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
-    #else
-        assert(0);
-    #endif
-
         assert(AreRequiredExtensionsPresent(activeInstanceExtensions, instanceExtensions));
 
         // Check for validation layer support
@@ -241,13 +329,18 @@ namespace Graphics {
             }
 
             // Call SDL to reassign surface
-            CreateSurface();
+            if (!_config.headless) {
+                CreateSurface();
+            }
 
             uint32_t count = static_cast<uint32_t>(queueFamilyProperties.size());
             for(uint32_t i = 0; i < count; i++) {
-                vk::Bool32 supportsPresent;
-                std::tie(result, supportsPresent) = gpu.getSurfaceSupportKHR(i, _surface);
-                VK_CHECK(result);
+                // Nothing is presented when headless, any graphics queue will do.
+                vk::Bool32 supportsPresent = VK_TRUE;
+                if (_surface) {
+                    std::tie(result, supportsPresent) = gpu.getSurfaceSupportKHR(i, _surface);
+                    VK_CHECK(result);
+                }
 
                 // Get queue family with graphics and present capabilities
                 if ((queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics) && supportsPresent) {
@@ -255,10 +348,23 @@ namespace Graphics {
                 }
             }
 
+            // Async uploads go to a transfer only family if there is one. Those usually map
+            // to the copy engines and run next to rendering instead of competing with it.
+            _transferQueueIndex = _graphicsQueueIndex;
+            for(uint32_t i = 0; i < count; i++) {
+                vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+                if ((flags & vk::QueueFlagBits::eTransfer) &&
+                    !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+                    _transferQueueIndex = i;
+                    break;
+                }
+            }
+
             _physicalDevice = gpu;
             _physicalDeviceProperties = gpu.getProperties();
             LOGI("Enabled GPU: {}", _physicalDeviceProperties.deviceName);
             LOGI("Atom Size: {}", _physicalDeviceProperties.limits.nonCoherentAtomSize);
+            LOGI("Queue families: graphics {}, transfer {}", _graphicsQueueIndex, _transferQueueIndex);
             break;
         }
 
@@ -284,23 +390,80 @@ namespace Graphics {
             extensions.push_back("VK_KHR_portability_subset");
         };
 
+        // Lets VMA report what the driver actually has left instead of estimating
+        // from its own allocations, which the memory budget is enforced against.
+        _memoryBudgetSupported = std::find_if(
+            supportedExtensions.begin(),
+            supportedExtensions.end(),
+            [](auto &extension) {
+                return strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+            }
+        ) != supportedExtensions.end();
+        if (_memoryBudgetSupported) {
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
         float queuePriority = 1.0f;
 
-        vk::DeviceQueueCreateInfo queueCreateInfo {
+        std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos {{
             {}, // Flags
             _graphicsQueueIndex,
             1, // Queue Count
             &queuePriority
-        };
+        }};
+
+        if (_transferQueueIndex != _graphicsQueueIndex) {
+            queueCreateInfos.push_back({{}, _transferQueueIndex, 1, &queuePriority});
+        }
+
+        // Upload batches are tracked with timeline semaphores.
+        vk::PhysicalDeviceTimelineSemaphoreFeatures timelineFeatures { VK_TRUE };
+
+        // Descriptor indexing is core in 1.2, but optional. Bindless textures need a
+        // partially bound array indexed per object, updated while frames are in flight.
+        auto supportedFeatures = _physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+        auto &supportedIndexing = supportedFeatures.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+        _bindless = _config.bindless &&
+                    supportedIndexing.runtimeDescriptorArray &&
+                    supportedIndexing.shaderSampledImageArrayNonUniformIndexing &&
+                    supportedIndexing.descriptorBindingPartiallyBound &&
+                    supportedIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+                    supportedIndexing.descriptorBindingUpdateUnusedWhilePending;
+        if (_config.bindless && !_bindless) {
+            LOGW("Descriptor indexing is not supported, textures are bound per material");
+        }
+
+        vk::PhysicalDeviceDescriptorIndexingFeatures indexingFeatures {};
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        if (_bindless) {
+            timelineFeatures.pNext = &indexingFeatures;
+        }
 
         vk::PhysicalDeviceShaderDrawParametersFeatures shaderFeatures { VK_TRUE };
+        shaderFeatures.pNext = &timelineFeatures;
+
+        // Cooked textures are block compressed where the device can sample BC formats.
+        vk::PhysicalDeviceFeatures supportedCore = _physicalDevice.getFeatures();
+        vk::PhysicalDeviceFeatures features {};
+        features.textureCompressionBC = supportedCore.textureCompressionBC;
+
+        // Indirect draws start each batch at its object range through firstInstance,
+        // and batches sharing every binding go out as one multi-draw.
+        _indirectFirstInstance = supportedCore.drawIndirectFirstInstance;
+        features.drawIndirectFirstInstance = supportedCore.drawIndirectFirstInstance;
+        features.multiDrawIndirect = supportedCore.multiDrawIndirect;
+        _maxDrawIndirectCount = supportedCore.multiDrawIndirect ? _physicalDeviceProperties.limits.maxDrawIndirectCount : 1;
 
         vk::DeviceCreateInfo deviceCreateInfo {
             {}, // Flags
-            queueCreateInfo,
+            queueCreateInfos,
             {},
             extensions,
-            {},
+            &features,
             &shaderFeatures
         };
 
@@ -308,6 +471,7 @@ namespace Graphics {
         VK_CHECK(result);
 
         _queue = _device.getQueue(_graphicsQueueIndex, 0);
+        _transferQueue = _device.getQueue(_transferQueueIndex, 0);
     }
 
     void Engine::CreateSurface() {
@@ -349,21 +513,20 @@ namespace Graphics {
             _device,
             {},
             _queue,
-            {},
+            _pipelineCache,
             _imguiPool,
             {},
-            3,
-            3,
+            std::max<uint32_t>(2, static_cast<uint32_t>(_perframes.size())),
+            std::max<uint32_t>(2, static_cast<uint32_t>(_perframes.size())),
             VK_SAMPLE_COUNT_1_BIT
         };
 
         ImGui_ImplVulkan_Init(&initInfo, _renderPass);
 
-        _uploadContext.Begin();
+        ImGui_ImplVulkan_CreateFontsTexture(_uploadContext.GetCommandBuffer());
 
-        ImGui_ImplVulkan_CreateFontsTexture(_uploadContext.cmd);
-
-        _uploadContext.SubmitSync(_queue);
+        // The font upload objects can only go once the copy has run.
+        _uploadContext.Wait(_uploadContext.Submit());
 
         ImGui_ImplVulkan_DestroyFontUploadObjects();
     }
@@ -458,17 +621,12 @@ namespace Graphics {
             {
                 _device.destroyImageView(imageView);
             }
-
-            std::vector<vk::Image> swapchainImages;
-            std::tie(result, swapchainImages) = _device.getSwapchainImagesKHR(oldSwapchain);
-            VK_CHECK(result);
-            size_t imageCount = swapchainImages.size();
-            for (size_t i = 0; i < imageCount; i++)
-            {
-                TeardownPerframe(_perframes[i]);
+            for (vk::Semaphore semaphore : _swapchainReleaseSemaphores) {
+                _device.destroySemaphore(semaphore);
             }
 
             _swapchainImageViews.clear();
+            _swapchainReleaseSemaphores.clear();
             _device.destroySwapchainKHR(oldSwapchain);
         }
 
@@ -480,13 +638,6 @@ namespace Graphics {
         VK_CHECK(result);
         size_t imageCount = swapchainImages.size();
 
-        _perframes.clear();
-        _perframes.resize(imageCount);
-
-        for(uint32_t i = 0; i < static_cast<uint32_t>(imageCount); i++) {
-            InitPerframe(_perframes[i], i);
-        }
-
         vk::ImageViewCreateInfo viewCreateInfo = {};
         viewCreateInfo.viewType = vk::ImageViewType::e2D;
         viewCreateInfo.format = _swapchainFormat;
@@ -494,8 +645,53 @@ namespace Graphics {
         viewCreateInfo.subresourceRange.layerCount = 1;
         viewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 
-        // Allocate the depth image
-        _depthFormat = vk::Format::eD32Sfloat;
+        for(size_t i = 0; i < imageCount; i++) {
+            viewCreateInfo.image = swapchainImages[i];
+            auto [result, imageView] = _device.createImageView(viewCreateInfo);
+            VK_CHECK(result);
+            _swapchainImageViews.push_back(imageView);
+
+            vk::Semaphore releaseSemaphore;
+            std::tie(result, releaseSemaphore) = _device.createSemaphore({});
+            VK_CHECK(result);
+            _swapchainReleaseSemaphores.push_back(releaseSemaphore);
+        }
+    }
+
+    void Engine::InitOffscreenTargets() {
+        vk::Result result;
+
+        _swapchainDimensions = vk::Extent2D {_config.width, _config.height};
+        _swapchainFormat = vk::Format::eR8G8B8A8Unorm;
+
+        // These images take the place of the swapchain images, one per frame in flight.
+        // They are left in eTransferSrcOptimal by the render pass so frames can be read back.
+        vk::Extent3D extent = { _swapchainDimensions.width, _swapchainDimensions.height, 1 };
+        for(size_t i = 0; i < _perframes.size(); i++) {
+            AllocatedImage image = CreateImage(
+                _swapchainFormat,
+                extent,
+                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc
+            );
+            _offscreenImages.push_back(image);
+
+            vk::ImageViewCreateInfo viewCreateInfo {{}, image.image, vk::ImageViewType::e2D, _swapchainFormat};
+            viewCreateInfo.subresourceRange.levelCount = 1;
+            viewCreateInfo.subresourceRange.layerCount = 1;
+            viewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+
+            vk::ImageView imageView;
+            std::tie(result, imageView) = _device.createImageView(viewCreateInfo);
+            VK_CHECK(result);
+            _swapchainImageViews.push_back(imageView);
+        }
+    }
+
+    void Engine::InitDepthImage(Perframe &perframe) {
+        vk::Result result;
+
+        // Depth is cleared on load and never read back, so mark it transient.
+        // On tilers this lets the driver keep it in tile memory and skip the allocation.
         vk::ImageCreateInfo depthBuffer {};
         vk::Extent3D extent = { _swapchainDimensions.width, _swapchainDimensions.height, 1 };
         depthBuffer.imageType = vk::ImageType::e2D;
@@ -505,38 +701,43 @@ namespace Graphics {
         depthBuffer.arrayLayers = 1;
         depthBuffer.samples = vk::SampleCountFlagBits::e1,
         depthBuffer.tiling = vk::ImageTiling::eOptimal;
-        depthBuffer.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        depthBuffer.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment;
 
         vma::AllocationCreateInfo depthAllocInfo {};
         depthAllocInfo.flags = {};
-        depthAllocInfo.usage = vma::MemoryUsage::eGpuOnly;
-        depthAllocInfo.requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+        depthAllocInfo.usage = vma::MemoryUsage::eGpuLazilyAllocated;
 
-        VK_CHECK(_allocator.createImage(&depthBuffer,
+        result = _allocator.createImage(&depthBuffer,
             &depthAllocInfo,
-            &_depthImage.image,
-            &_depthImage.allocation,
-            &_depthImage.allocInfo));
+            &perframe.depthImage.image,
+            &perframe.depthImage.allocation,
+            &perframe.depthImage.allocInfo);
+
+        // Most desktop GPUs have no lazily allocated memory, use regular device memory instead.
+        if (result != vk::Result::eSuccess) {
+            depthAllocInfo.usage = vma::MemoryUsage::eGpuOnly;
+            depthAllocInfo.requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+            VK_CHECK(_allocator.createImage(&depthBuffer,
+                &depthAllocInfo,
+                &perframe.depthImage.image,
+                &perframe.depthImage.allocation,
+                &perframe.depthImage.allocInfo));
+        }
+        perframe.depthImage.format = _depthFormat;
+        perframe.depthImage.extent = extent;
 
         vk::ImageViewCreateInfo depthViewInfo {};
-        depthViewInfo.image = _depthImage.image;
+        depthViewInfo.image = perframe.depthImage.image;
         depthViewInfo.viewType = vk::ImageViewType::e2D;
         depthViewInfo.format = _depthFormat;
         depthViewInfo.subresourceRange.baseMipLevel = 0;
         depthViewInfo.subresourceRange.levelCount = 1;
-        depthViewInfo.subresourceRange.layerCount = 0;
         depthViewInfo.subresourceRange.layerCount = 1;
         depthViewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
 
-        std::tie(result, _depthImageView) = _device.createImageView(depthViewInfo);
+        std::tie(result, perframe.depthImageView) = _device.createImageView(depthViewInfo);
         VK_CHECK(result);
-
-        for(size_t i = 0; i < imageCount; i++) {
-            viewCreateInfo.image = swapchainImages[i];
-            auto [result, imageView] = _device.createImageView(viewCreateInfo);
-            VK_CHECK(result);
-            _swapchainImageViews.push_back(imageView);
-        }
     }
 
     vk::PresentModeKHR Engine::ChooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes) {
@@ -574,11 +775,31 @@ namespace Graphics {
         }
     }
 
+    void Engine::InitPerframes() {
+        uint32_t count = std::max<uint32_t>(1, _config.framesInFlight);
+
+        _perframes.clear();
+        _perframes.resize(count);
+
+        for(uint32_t i = 0; i < count; i++) {
+            InitPerframe(_perframes[i], i);
+        }
+    }
+
     void Engine::InitPerframe(Perframe &perframe, uint32_t index) {
         vk::Result result;
         std::tie(result, perframe.queueSubmitFence) = _device.createFence({vk::FenceCreateFlagBits::eSignaled});
         assert(result == vk::Result::eSuccess);
 
+        // Waiting on queueSubmitFence also guarantees the submit that waited on this
+        // semaphore has completed, so each frame can own it outright. Release
+        // semaphores are waited on by present, which the fence doesn't cover, so
+        // those belong to the swapchain images instead.
+        if (!_config.headless) {
+            std::tie(result, perframe.swapchainAcquireSemaphore) = _device.createSemaphore({});
+            assert(result == vk::Result::eSuccess);
+        }
+
         vk::CommandPoolCreateInfo cmdPoolInfo {
             vk::CommandPoolCreateFlagBits::eTransient |
             vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
@@ -599,31 +820,266 @@ namespace Graphics {
         assert(result == vk::Result::eSuccess);
         perframe.primaryCommandBuffer = cmdBuf.front();
 
-        perframe.cameraBuffer = CreateBuffer(
-            sizeof(GPUCameraData),
-            vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eHostAccessAllowTransferInstead,
+        // A slot per thread that can record (workers plus the calling thread), plus the GUI.
+        size_t secondarySlots = jobs.GetThreadCount() + 2;
+        for (size_t i = 0; i < secondarySlots; i++) {
+            vk::CommandPool pool;
+            std::tie(result, pool) = _device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, _graphicsQueueIndex});
+            assert(result == vk::Result::eSuccess);
+
+            std::tie(result, cmdBuf) = _device.allocateCommandBuffers({pool, vk::CommandBufferLevel::eSecondary, 1});
+            assert(result == vk::Result::eSuccess);
+
+            perframe.secondaryCommandPools.push_back(pool);
+            perframe.secondaryCommandBuffers.push_back(cmdBuf.front());
+        }
+
+        InitObjectBuffer(perframe, std::max<size_t>(1, _config.initialObjectCapacity));
+        InitCullBuffers(perframe, 64);
+
+        perframe.device = _device;
+        perframe.queueIndex = _graphicsQueueIndex;
+        perframe.perframeIndex = index;
+        perframe.imageIndex = 0;
+    }
+
+    void Engine::InitObjectBuffer(Perframe &perframe, size_t capacity) {
+        // Mapped for the lifetime of the frame so objects are written straight into it.
+        perframe.objectBuffer = CreateBuffer(
+            sizeof(GPUObjectData) * capacity,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+            {},
+            vma::MemoryUsage::eAuto
+        );
+        perframe.objectCapacity = capacity;
+        perframe.objectCount = 0;
+    }
+
+    void Engine::UpdateObjectDescriptor(Perframe &perframe) {
+        vk::DescriptorBufferInfo objectBufferInfo {perframe.objectBuffer.buffer, 0, VK_WHOLE_SIZE};
+        _device.updateDescriptorSetWithTemplate(perframe.objectDescriptor, _objectUpdateTemplate, &objectBufferInfo);
+    }
+
+    static size_t GrowCapacity(size_t capacity, size_t count) {
+        capacity = std::max<size_t>(capacity, 1);
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    GPUObjectData* Engine::ReserveObjects(Perframe &perframe, size_t count) {
+        if (count > perframe.objectCapacity) {
+            size_t capacity = GrowCapacity(perframe.objectCapacity, count);
+
+            // Only this frame's buffer is replaced. Its fence has signaled, so neither the
+            // buffer nor the descriptor sets pointing at it are used by any pending work.
+            DestroyBuffer(perframe.objectBuffer);
+            InitObjectBuffer(perframe, capacity);
+            UpdateObjectDescriptor(perframe);
+            UpdateCullDescriptor(perframe);
+
+            LOGI("Grew object buffer of frame {} to {} objects", perframe.perframeIndex, capacity);
+        }
+
+        perframe.objectCount = count;
+        _objectHighWaterMark = std::max(_objectHighWaterMark, count);
+
+        return reinterpret_cast<GPUObjectData *>(perframe.objectBuffer.allocInfo.pMappedData);
+    }
+
+    void Engine::ReserveObjectCapacity(size_t count) {
+        VK_CHECK(_device.waitIdle());
+
+        for(auto &perframe : _perframes) {
+            if (count > perframe.objectCapacity) {
+                DestroyBuffer(perframe.objectBuffer);
+                InitObjectBuffer(perframe, count);
+                UpdateObjectDescriptor(perframe);
+                UpdateCullDescriptor(perframe);
+            }
+        }
+    }
+
+    ObjectBufferStats Engine::GetObjectBufferStats() {
+        ObjectBufferStats stats {SIZE_MAX, _objectHighWaterMark};
+        for(auto &perframe : _perframes) {
+            stats.capacity = std::min(stats.capacity, perframe.objectCapacity);
+        }
+        return stats;
+    }
+
+    void Engine::InitCullBuffers(Perframe &perframe, size_t drawCapacity) {
+        // Created by RecordSceneWrites, sized to the most objects changed in one frame.
+        perframe.sceneUploadBuffer = {};
+        perframe.sceneUploadCapacity = 0;
+        perframe.sceneUploadCount = 0;
+
+        // Written by the CPU with zero instances, then counted up by the culling shader.
+        perframe.drawCommandBuffer = CreateBuffer(
+            sizeof(vk::DrawIndexedIndirectCommand) * drawCapacity,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
             {},
             vma::MemoryUsage::eAuto
         );
+        perframe.drawCommandCapacity = drawCapacity;
+        perframe.drawCommandCount = 0;
+    }
 
-        perframe.objectBuffer = CreateBuffer(
-            sizeof(GPUObjectData) * MAX_OBJECTS,
-            vk::BufferUsageFlagBits::eStorageBuffer,
-            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
+    void Engine::InitSceneObjectBuffer(size_t capacity) {
+        _sceneObjectBuffer = CreateBuffer(
+            sizeof(GPUCullObject) * capacity,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            {},
             {},
             vma::MemoryUsage::eAuto
         );
+        _sceneObjectCapacity = capacity;
+    }
+
+    void Engine::UpdateCullDescriptor(Perframe &perframe) {
+        vk::DescriptorBufferInfo bufferInfos[] = {
+            {_sceneObjectBuffer.buffer, 0, VK_WHOLE_SIZE},
+            {perframe.drawCommandBuffer.buffer, 0, VK_WHOLE_SIZE},
+            {perframe.objectBuffer.buffer, 0, VK_WHOLE_SIZE}
+        };
+        _device.updateDescriptorSetWithTemplate(perframe.cullDescriptor, _cullUpdateTemplate, bufferInfos);
+    }
+
+    bool Engine::ReserveSceneObjects(size_t count) {
+        if (count <= _sceneObjectCapacity) return false;
+
+        // Every frame in flight culls from this buffer and has its descriptor pointing at it.
+        VK_CHECK(_device.waitIdle());
+
+        DestroyBuffer(_sceneObjectBuffer);
+        InitSceneObjectBuffer(GrowCapacity(_sceneObjectCapacity, count));
+        for(auto &perframe : _perframes) {
+            UpdateCullDescriptor(perframe);
+        }
+
+        LOGI("Grew scene object buffer to {} objects", _sceneObjectCapacity);
+        return true;
+    }
+
+    void Engine::RecordSceneWrites(Perframe &perframe, const std::vector<uint32_t> &slots, const std::vector<GPUCullObject> &objects) {
+        assert(slots.size() == objects.size());
+        if (objects.empty()) return;
+
+        // The frame's fence has signaled, nothing reads its staging buffer anymore.
+        if (objects.size() > perframe.sceneUploadCapacity) {
+            if (perframe.sceneUploadCapacity > 0) {
+                DestroyBuffer(perframe.sceneUploadBuffer);
+            }
+            perframe.sceneUploadCapacity = GrowCapacity(perframe.sceneUploadCapacity, objects.size());
+            perframe.sceneUploadBuffer = CreateBuffer(
+                sizeof(GPUCullObject) * perframe.sceneUploadCapacity,
+                vk::BufferUsageFlagBits::eTransferSrc,
+                vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+                {},
+                vma::MemoryUsage::eAuto
+            );
+        }
+
+        memcpy(perframe.sceneUploadBuffer.allocInfo.pMappedData, objects.data(), objects.size() * sizeof(GPUCullObject));
+        perframe.sceneUploadCount = objects.size();
+
+        // Runs of consecutive slots, as after a rebuild, become a single region.
+        std::vector<vk::BufferCopy> regions;
+        for (size_t i = 0; i < slots.size(); i++) {
+            vk::DeviceSize dst = slots[i] * sizeof(GPUCullObject);
+            if (!regions.empty() && regions.back().dstOffset + regions.back().size == dst &&
+                regions.back().srcOffset + regions.back().size == i * sizeof(GPUCullObject)) {
+                regions.back().size += sizeof(GPUCullObject);
+                continue;
+            }
+            regions.push_back({i * sizeof(GPUCullObject), dst, sizeof(GPUCullObject)});
+        }
+
+        auto cmd = perframe.primaryCommandBuffer;
+
+        // Earlier frames may still be culling from the slots being overwritten.
+        cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            {},
+            {},
+            {}
+        );
 
-        perframe.device = _device;
-        perframe.queueIndex = _graphicsQueueIndex;
-        perframe.perframeIndex = index;
+        cmd.copyBuffer(perframe.sceneUploadBuffer.buffer, _sceneObjectBuffer.buffer, regions);
+
+        vk::MemoryBarrier barrier {vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead};
+        cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eComputeShader,
+            {},
+            barrier,
+            {},
+            {}
+        );
+    }
+
+    vk::DrawIndexedIndirectCommand* Engine::ReserveDrawCommands(Perframe &perframe, size_t objectCount, size_t drawCount) {
+        // Every object may survive culling, so the compacted output needs room for all of them.
+        ReserveObjects(perframe, objectCount);
+
+        if (drawCount > perframe.drawCommandCapacity) {
+            DestroyBuffer(perframe.drawCommandBuffer);
+            size_t capacity = GrowCapacity(perframe.drawCommandCapacity, drawCount);
+            perframe.drawCommandBuffer = CreateBuffer(
+                sizeof(vk::DrawIndexedIndirectCommand) * capacity,
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+                {},
+                vma::MemoryUsage::eAuto
+            );
+            perframe.drawCommandCapacity = capacity;
+            UpdateCullDescriptor(perframe);
+        }
+
+        perframe.drawCommandCount = drawCount;
+        return reinterpret_cast<vk::DrawIndexedIndirectCommand *>(perframe.drawCommandBuffer.allocInfo.pMappedData);
+    }
+
+    void Engine::RecordCulling(Perframe &perframe, const Frustum &frustum, uint32_t objectCount) {
+        auto cmd = perframe.primaryCommandBuffer;
+
+        GPUCullConstants constants;
+        std::copy(std::begin(frustum.planes), std::end(frustum.planes), std::begin(constants.planes));
+        constants.objectCount = objectCount;
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, _cullPipeline);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _cullPipelineLayout, 0, perframe.cullDescriptor, {});
+        cmd.pushConstants(_cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(GPUCullConstants), &constants);
+        cmd.dispatch((objectCount + 63) / 64, 1, 1);
+
+        // Instance counts feed the indirect draws, compacted objects feed the vertex shader.
+        vk::MemoryBarrier barrier {
+            vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead
+        };
+        cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+            {},
+            barrier,
+            {},
+            {}
+        );
     }
 
     void Engine::TeardownPerframe(Perframe &perframe) {
+        perframe.descriptorAllocator.Destroy();
 
         _allocator.destroyBuffer(perframe.objectBuffer.buffer, perframe.objectBuffer.allocation);
-        _allocator.destroyBuffer(perframe.cameraBuffer.buffer, perframe.cameraBuffer.allocation);
+        if (perframe.sceneUploadCapacity > 0) {
+            _allocator.destroyBuffer(perframe.sceneUploadBuffer.buffer, perframe.sceneUploadBuffer.allocation);
+        }
+        _allocator.destroyBuffer(perframe.drawCommandBuffer.buffer, perframe.drawCommandBuffer.allocation);
 
         _device.destroyFence(perframe.queueSubmitFence);
         perframe.queueSubmitFence = nullptr;
@@ -632,24 +1088,27 @@ namespace Graphics {
         perframe.primaryCommandBuffer = nullptr;
 
         _device.destroyCommandPool(perframe.primaryCommandPool);
+        for (auto pool : perframe.secondaryCommandPools) {
+            _device.destroyCommandPool(pool);
+        }
+        perframe.secondaryCommandPools.clear();
+        perframe.secondaryCommandBuffers.clear();
         perframe.primaryCommandPool = nullptr;
 
         _device.destroySemaphore(perframe.swapchainAcquireSemaphore);
         perframe.swapchainAcquireSemaphore = nullptr;
 
-        _device.destroySemaphore(perframe.swapchainReleaseSemaphore);
-        perframe.swapchainReleaseSemaphore = nullptr;
-
         perframe.device = nullptr;
         perframe.queueIndex = -1;
         perframe.perframeIndex = -1;
+        perframe.imageIndex = -1;
     }
 
     void Engine::InitDescriptorSetLayouts() {
         vk::Result result;
 
         // Global information descriptor set layout
-        vk::DescriptorSetLayoutBinding cameraBinding {0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex};
+        vk::DescriptorSetLayoutBinding cameraBinding {0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex};
         vk::DescriptorSetLayoutBinding sceneBinding {1, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment};
         vk::DescriptorSetLayoutBinding bindings[] = {cameraBinding, sceneBinding};
         std::tie(result, _globalSetLayout) = _device.createDescriptorSetLayout({{}, bindings});
@@ -663,72 +1122,216 @@ namespace Graphics {
         vk::DescriptorSetLayoutBinding textureBinding {0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment};
         std::tie(result, _singleTextureSetLayout) = _device.createDescriptorSetLayout({{}, textureBinding});
         VK_CHECK(result);
+
+        // Or every texture in one array. Slots are written as textures become resident,
+        // while frames using other slots may still be in flight.
+        if (_bindless) {
+            auto properties = _physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+            auto &indexing = properties.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+            _bindlessCapacity = std::min({
+                _config.maxBindlessTextures,
+                indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+                indexing.maxDescriptorSetUpdateAfterBindSamplers,
+                indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                indexing.maxPerStageDescriptorUpdateAfterBindSamplers
+            });
+
+            vk::DescriptorSetLayoutBinding texturesBinding {0, vk::DescriptorType::eCombinedImageSampler, _bindlessCapacity, vk::ShaderStageFlagBits::eFragment};
+            vk::DescriptorBindingFlags texturesFlags = vk::DescriptorBindingFlagBits::ePartiallyBound |
+                                                       vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+                                                       vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+            vk::DescriptorSetLayoutBindingFlagsCreateInfo texturesFlagsInfo {1, &texturesFlags};
+
+            vk::DescriptorSetLayoutCreateInfo bindlessInfo {vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, texturesBinding};
+            bindlessInfo.pNext = &texturesFlagsInfo;
+            std::tie(result, _bindlessSetLayout) = _device.createDescriptorSetLayout(bindlessInfo);
+            VK_CHECK(result);
+        }
+
+        // Culling compute set: objects in, draw commands, compacted objects out
+        vk::DescriptorSetLayoutBinding cullBindings[] = {
+            {0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute}
+        };
+        std::tie(result, _cullSetLayout) = _device.createDescriptorSetLayout({{}, cullBindings});
+        VK_CHECK(result);
+
+        // Mip generation compute set: previous level in, next level out
+        vk::DescriptorSetLayoutBinding mipBindings[] = {
+            {0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute},
+            {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}
+        };
+        std::tie(result, _mipSetLayout) = _device.createDescriptorSetLayout({{}, mipBindings});
+        VK_CHECK(result);
+    }
+
+    static vk::DescriptorUpdateTemplate CreateUpdateTemplate(vk::Device device, vk::DescriptorSetLayout layout,
+                                                             const std::vector<vk::DescriptorUpdateTemplateEntry> &entries) {
+        vk::DescriptorUpdateTemplateCreateInfo templateInfo {{}, entries, vk::DescriptorUpdateTemplateType::eDescriptorSet, layout};
+        auto [result, updateTemplate] = device.createDescriptorUpdateTemplate(templateInfo);
+        VK_CHECK(result);
+        return updateTemplate;
+    }
+
+    void Engine::InitDescriptorUpdateTemplates() {
+        // One entry per binding, reading consecutive infos.
+        _textureUpdateTemplate = CreateUpdateTemplate(_device, _singleTextureSetLayout, {
+            {0, 0, 1, vk::DescriptorType::eCombinedImageSampler, 0, sizeof(vk::DescriptorImageInfo)}
+        });
+
+        _objectUpdateTemplate = CreateUpdateTemplate(_device, _objectSetLayout, {
+            {0, 0, 1, vk::DescriptorType::eStorageBuffer, 0, sizeof(vk::DescriptorBufferInfo)}
+        });
+
+        _cullUpdateTemplate = CreateUpdateTemplate(_device, _cullSetLayout, {
+            {0, 0, 1, vk::DescriptorType::eStorageBuffer, 0, sizeof(vk::DescriptorBufferInfo)},
+            {1, 0, 1, vk::DescriptorType::eStorageBuffer, sizeof(vk::DescriptorBufferInfo), sizeof(vk::DescriptorBufferInfo)},
+            {2, 0, 1, vk::DescriptorType::eStorageBuffer, 2 * sizeof(vk::DescriptorBufferInfo), sizeof(vk::DescriptorBufferInfo)}
+        });
     }
 
     void Engine::InitDescriptors() {
         vk::Result result;
-        const int MAX_OBJECTS = 10000;
-
-        // Create descriptor pool
-        std::vector<vk::DescriptorPoolSize> sizes = {
-            { vk::DescriptorType::eUniformBuffer, 10 },
-            { vk::DescriptorType::eUniformBufferDynamic, 10 },
-            { vk::DescriptorType::eStorageBuffer, 10 },
-            { vk::DescriptorType::eCombinedImageSampler, 10 }
-        };
 
-        vk::DescriptorPoolCreateInfo poolInfo {{}, 10, sizes};
+        // Texture sets are replaced when async textures land, so sets can be freed.
+        // Pools are added as materials need more.
+        _descriptorAllocator.Init(_device, 32, {
+            { vk::DescriptorType::eUniformBufferDynamic, 1.f },
+            { vk::DescriptorType::eStorageBuffer, 2.f },
+            { vk::DescriptorType::eCombinedImageSampler, 1.f }
+        }, true);
+
+        if (_bindless) {
+            vk::DescriptorPoolSize bindlessSize {vk::DescriptorType::eCombinedImageSampler, _bindlessCapacity};
+            std::tie(result, _bindlessPool) = _device.createDescriptorPool({vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, bindlessSize});
+            VK_CHECK(result);
 
-        std::tie(result, _descriptorPool) = _device.createDescriptorPool(poolInfo);
-        VK_CHECK(result);
+            std::vector<vk::DescriptorSet> bindlessDescriptors;
+            std::tie(result, bindlessDescriptors) = _device.allocateDescriptorSets({_bindlessPool, _bindlessSetLayout});
+            VK_CHECK(result);
+            _bindlessSet = bindlessDescriptors[0];
+        }
 
         for(int i  = 0; i < _perframes.size(); i++) {
             // Does not need to be explicitly freed
-            std::vector<vk::DescriptorSet> descriptors;
-            std::tie(result, descriptors) = _device.allocateDescriptorSets({_descriptorPool, _globalSetLayout});
-            VK_CHECK(result);
-            _perframes[i].globalDescriptor = descriptors[0];
+            _perframes[i].globalDescriptor = _descriptorAllocator.Allocate(_globalSetLayout);
+            _perframes[i].objectDescriptor = _descriptorAllocator.Allocate(_objectSetLayout);
+            _perframes[i].cullDescriptor = _descriptorAllocator.Allocate(_cullSetLayout);
 
-            std::vector<vk::DescriptorSet> objectDescriptors;
-            std::tie(result, objectDescriptors) = _device.allocateDescriptorSets({_descriptorPool, _objectSetLayout});
-            VK_CHECK(result);
-            _perframes[i].objectDescriptor = objectDescriptors[0];
+            _perframes[i].descriptorAllocator.Init(_device, 64, {
+                { vk::DescriptorType::eUniformBufferDynamic, 1.f },
+                { vk::DescriptorType::eStorageBuffer, 2.f },
+                { vk::DescriptorType::eCombinedImageSampler, 2.f },
+                { vk::DescriptorType::eStorageImage, 1.f }
+            }, false);
 
-            // point the descriptor set to the buffers
-            vk::DescriptorBufferInfo cameraBufferInfo {_perframes[i].cameraBuffer.buffer, 0, sizeof(GPUCameraData)};
-            vk::DescriptorBufferInfo sceneBufferInfo {sceneParamsBuffer.buffer, 0, sizeof(GPUSceneData)};
-            vk::DescriptorBufferInfo objectBufferInfo {_perframes[i].objectBuffer.buffer, 0, sizeof(GPUObjectData) * MAX_OBJECTS};
+            // point the descriptor set to the buffers, uniforms are located by their dynamic offsets
+            vk::DescriptorBufferInfo cameraBufferInfo {frameAllocator.buffer.buffer, 0, sizeof(GPUCameraData)};
+            vk::DescriptorBufferInfo sceneBufferInfo {frameAllocator.buffer.buffer, 0, sizeof(GPUSceneData)};
 
             vk::WriteDescriptorSet setWrites[] = {
-                {_perframes[i].globalDescriptor, 0, 0, vk::DescriptorType::eUniformBuffer, nullptr, cameraBufferInfo},
-                {_perframes[i].globalDescriptor, 1, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, sceneBufferInfo},
-                {_perframes[i].objectDescriptor, 0, 0, vk::DescriptorType::eStorageBuffer, nullptr, objectBufferInfo}
+                {_perframes[i].globalDescriptor, 0, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, cameraBufferInfo},
+                {_perframes[i].globalDescriptor, 1, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, sceneBufferInfo}
             };
 
             _device.updateDescriptorSets(setWrites, {});
+            UpdateObjectDescriptor(_perframes[i]);
+            UpdateCullDescriptor(_perframes[i]);
         }
     }
 
     void Engine::InitUploadContext() {
-        _uploadContext.Init(_device, _graphicsQueueIndex);
+        _uploadContext.Init(_device, _allocator, _queue, _graphicsQueueIndex, _config.stagingSize);
+
+        // Streaming workers fill their own staging buffers, the transfer context only batches the copies.
+        _transferContext.Init(_device, _allocator, _transferQueue, _transferQueueIndex, 0);
+    }
+
+    void Engine::InitPlaceholders() {
+        // What async meshes draw as until they are resident, a small octahedron.
+        Mesh mesh;
+        glm::vec3 corners[] = {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+        };
+        for (const glm::vec3 &corner : corners) {
+            Vertex vertex;
+            vertex.position = corner;
+            vertex.normal = corner;
+            vertex.color = glm::vec3 {0.5f};
+            vertex.uv = glm::vec2 {0.5f};
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices = {
+            0, 2, 4,  2, 1, 4,  1, 3, 4,  3, 0, 4,
+            2, 0, 5,  1, 2, 5,  3, 1, 5,  0, 3, 5
+        };
+        CreateMesh("placeholder", mesh);
+
+        // And async textures, a single mid grey texel.
+        Texture texture;
+        uint8_t texel[4] = {128, 128, 128, 255};
+        texture.image = CreateImage(vk::Format::eR8G8B8A8Srgb, {1, 1, 1}, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+        UploadImage(texture.image, texel);
+        InitTextureSampling(texture);
+        _textures["placeholder"] = texture;
     }
 
     void Engine::InitPipeline() {
         vk::Result result;
-        PipelineBuilder builder;
 
         // Create push constant accesible only to vertex shader
         vk::PushConstantRange pushConstant {vk::ShaderStageFlagBits::eVertex, 0, sizeof(MeshPushConstants)};
 
 
         // Create a pipeline layout with 1 push constant.
-        vk::DescriptorSetLayout setLayouts[] = {_globalSetLayout, _objectSetLayout, _singleTextureSetLayout};
+        vk::DescriptorSetLayout textureSetLayout = _bindless ? _bindlessSetLayout : _singleTextureSetLayout;
+        vk::DescriptorSetLayout setLayouts[] = {_globalSetLayout, _objectSetLayout, textureSetLayout};
         std::tie(result, _pipelineLayout) = _device.createPipelineLayout({{}, setLayouts, pushConstant});
         VK_CHECK(result);
 
-        builder.SetPipelineLayout(_pipelineLayout);
+        // Built right away with every feature off, it's what other materials draw
+        // with until theirs are compiled.
+        std::tie(result, _pipeline) = _pipelineRegistry.Acquire(GetVariantBuilder(VertexFormat::Full, {}));
+        VK_CHECK(result);
 
-        VertexInputDescription vertexInputDescription = Vertex::GetInputDescription();
+        std::tie(result, _compactPipeline) = _pipelineRegistry.Acquire(GetVariantBuilder(VertexFormat::Compact, {}));
+        VK_CHECK(result);
+
+        CreateMaterial(_pipeline, _compactPipeline, _pipelineLayout, "default");
+    }
+
+    PipelineBuilder Engine::GetVariantBuilder(VertexFormat format, const ShaderVariant &variant) {
+        vk::ShaderModule vertShader = LoadShaderModule(format == VertexFormat::Compact
+            ? "shader_compact.vert"
+            : "shader.vert");
+        vk::ShaderModule fragShader = LoadShaderModule(_bindless
+            ? "shader_bindless.frag"
+            : "shader.frag");
+
+        // Only the fragment stage branches on features.
+        std::array<vk::SpecializationMapEntry, 2> entries = {{
+            {0, offsetof(ShaderVariant, fog), sizeof(vk::Bool32)},
+            {1, offsetof(ShaderVariant, lighting), sizeof(vk::Bool32)}
+        }};
+        vk::SpecializationInfo specialization {};
+        specialization.setMapEntries(entries);
+        specialization.dataSize = sizeof(ShaderVariant);
+        specialization.pData = &variant;
+
+        PipelineBuilder builder = GetPipelineBuilder(format);
+        builder.AddShaderModule({{}, vk::ShaderStageFlagBits::eVertex, vertShader, "main"});
+        builder.AddShaderModule({{}, vk::ShaderStageFlagBits::eFragment, fragShader, "main", &specialization});
+        return builder;
+    }
+
+    PipelineBuilder Engine::GetPipelineBuilder(VertexFormat format) {
+        PipelineBuilder builder;
+        builder.SetPipelineLayout(_pipelineLayout);
+
+        VertexInputDescription vertexInputDescription = format == VertexFormat::Compact
+            ? CompactVertex::GetInputDescription()
+            : Vertex::GetInputDescription();
 
         builder.SetVertexInput({{},
             static_cast<uint32_t>(vertexInputDescription.bindings.size()),
@@ -780,19 +1383,47 @@ namespace Graphics {
         std::array<vk::DynamicState, 2> dynamics {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
         builder.SetDynamicState({ {}, dynamics });
 
-        vk::ShaderModule vertShader = LoadShaderModule("assets/shaders/shader.vert.spv");
-        vk::ShaderModule fragShader = LoadShaderModule("assets/shaders/shader.frag.spv");
-        builder.AddShaderModule({{}, vk::ShaderStageFlagBits::eVertex, vertShader, "main"});
-        builder.AddShaderModule({{}, vk::ShaderStageFlagBits::eFragment, fragShader, "main"});
+        return builder;
+    }
+
+    void Engine::InitCullPipeline() {
+        vk::Result result;
+
+        vk::PushConstantRange pushConstant {vk::ShaderStageFlagBits::eCompute, 0, sizeof(GPUCullConstants)};
+        std::tie(result, _cullPipelineLayout) = _device.createPipelineLayout({{}, _cullSetLayout, pushConstant});
+        VK_CHECK(result);
+
+        vk::ShaderModule cullShader = LoadShaderModule("cull.comp");
+
+        vk::ComputePipelineCreateInfo pipelineInfo {
+            {},
+            {{}, vk::ShaderStageFlagBits::eCompute, cullShader, "main"},
+            _cullPipelineLayout
+        };
+        std::tie(result, _cullPipeline) = _device.createComputePipeline(_pipelineCache, pipelineInfo);
+        VK_CHECK(result);
+    }
 
-        std::tie(result, _pipeline) = builder.Build(_device, _renderPass);
+    void Engine::InitMipPipeline() {
+        vk::Result result;
+
+        vk::PushConstantRange pushConstant {vk::ShaderStageFlagBits::eCompute, 0, sizeof(GPUMipConstants)};
+        std::tie(result, _mipPipelineLayout) = _device.createPipelineLayout({{}, _mipSetLayout, pushConstant});
         VK_CHECK(result);
 
-        _device.destroyShaderModule(vertShader);
-        _device.destroyShaderModule(fragShader);
-        builder.FlushShaderModules();
+        vk::ShaderModule mipShader = LoadShaderModule("mip.comp");
 
-        CreateMaterial(_pipeline, _pipelineLayout, "default");
+        vk::ComputePipelineCreateInfo pipelineInfo {
+            {},
+            {{}, vk::ShaderStageFlagBits::eCompute, mipShader, "main"},
+            _mipPipelineLayout
+        };
+        std::tie(result, _mipPipeline) = _device.createComputePipeline(_pipelineCache, pipelineInfo);
+        VK_CHECK(result);
+
+        // The shader only fetches texels, filtering doesn't matter.
+        std::tie(result, _mipSampler) = _device.createSampler({});
+        VK_CHECK(result);
     }
 
     void Engine::InitRenderPass() {
@@ -813,7 +1444,10 @@ namespace Graphics {
         // On render pass begin, image layout undefined
         colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
         // After render pass is complete, transition to PresentSrcKHR layout.
-        colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+        // Offscreen images are copied out instead of presented.
+        colorAttachment.finalLayout = _config.headless
+            ? vk::ImageLayout::eTransferSrcOptimal
+            : vk::ImageLayout::ePresentSrcKHR;
 
         // One subpass, this subpass has one color attachment.
         // While executing this subpass, the attachment will be in attachment optimal layout.
@@ -824,8 +1458,9 @@ namespace Graphics {
         depthAttachment.format = _depthFormat;
         depthAttachment.samples = vk::SampleCountFlagBits::e1;
         depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-        depthAttachment.storeOp = vk::AttachmentStoreOp::eStore;
-        depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eClear;
+        // Depth is not needed after the pass, which lets it live in a transient attachment.
+        depthAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+        depthAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare; 
         depthAttachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
         vk::AttachmentReference depthRef = {1, vk::ImageLayout::eDepthStencilAttachmentOptimal};
@@ -866,33 +1501,37 @@ namespace Graphics {
         VK_CHECK(result);
     }
 
-    void Engine::InitSceneBuffer() {
-        // Create global scene parameters buffer
-        const size_t sceneParametersBufferSize = _perframes.size() * PadUniformBufferSize(sizeof(GPUSceneData));
-        sceneParamsBuffer = CreateBuffer(
-            sceneParametersBufferSize,
-            vk::BufferUsageFlagBits::eUniformBuffer,
-            {},
-            {},
-            vma::MemoryUsage::eCpuToGpu
+    void Engine::InitFrameAllocator() {
+        // Offsets handed out must satisfy both uniform and storage buffer alignment.
+        size_t alignment = std::max(
+            _physicalDeviceProperties.limits.minUniformBufferOffsetAlignment,
+            _physicalDeviceProperties.limits.minStorageBufferOffsetAlignment
         );
+
+        frameAllocator.Init(_allocator, _config.frameDataSize, static_cast<uint32_t>(_perframes.size()), alignment);
     }
 
     void Engine::InitFramebuffers() {
 
-        for (auto &imageView : _swapchainImageViews) {
-            std::array<vk::ImageView, 2> attachments = {imageView, _depthImageView};
-            vk::FramebufferCreateInfo fbInfo {
-                {},
-                _renderPass,
-                attachments,
-                _swapchainDimensions.width,
-                _swapchainDimensions.height,
-                1
-            };
-            auto [result, framebuffer] = _device.createFramebuffer(fbInfo);
-            VK_CHECK(result);
-            _swapchainFramebuffers.push_back(framebuffer);
+        // Any frame in flight may be handed any swapchain image, so every frame
+        // gets a framebuffer per image pairing it with that frame's depth attachment.
+        for (auto &perframe : _perframes) {
+            InitDepthImage(perframe);
+
+            for (auto &imageView : _swapchainImageViews) {
+                std::array<vk::ImageView, 2> attachments = {imageView, perframe.depthImageView};
+                vk::FramebufferCreateInfo fbInfo {
+                    {},
+                    _renderPass,
+                    attachments,
+                    _swapchainDimensions.width,
+                    _swapchainDimensions.height,
+                    1
+                };
+                auto [result, framebuffer] = _device.createFramebuffer(fbInfo);
+                VK_CHECK(result);
+                perframe.framebuffers.push_back(framebuffer);
+            }
         }
     }
 
@@ -908,6 +1547,9 @@ namespace Graphics {
         allocatorInfo.device = _device;
         allocatorInfo.instance = _instance;
         allocatorInfo.pVulkanFunctions = &vulkanFunctions; 
+        if (_memoryBudgetSupported) {
+            allocatorInfo.flags |= vma::AllocatorCreateFlagBits::eExtMemoryBudget;
+        }
 
         vk::Result result;
         std::tie(result, _allocator) = vma::createAllocator(allocatorInfo);
@@ -915,7 +1557,14 @@ namespace Graphics {
 
     }
 
-    void Engine::BeginRenderPass() {
+    void Engine::BeginRenderPass(vk::SubpassContents contents) {
+        if (_renderPassActive) {
+            assert(contents == _renderPassContents);
+            return;
+        }
+        _renderPassActive = true;
+        _renderPassContents = contents;
+
         auto cmd = currentPerframe->primaryCommandBuffer;
 
         vk::ClearValue clearValue;
@@ -927,13 +1576,39 @@ namespace Graphics {
         std::array<vk::ClearValue, 2> clearValues = {clearValue, depthClear};
 
         vk::RenderPassBeginInfo rpBeginInfo {
-            _renderPass, _swapchainFramebuffers[currentPerframe->perframeIndex],
+            _renderPass, currentPerframe->framebuffers[currentPerframe->imageIndex],
             {{0, 0}, {_swapchainDimensions.width, _swapchainDimensions.height}},
             clearValues
         };
 
-        cmd.beginRenderPass(rpBeginInfo, vk::SubpassContents::eInline);
+        cmd.beginRenderPass(rpBeginInfo, contents);
 
+        // Dynamic state isn't inherited, each secondary sets its own.
+        if (contents == vk::SubpassContents::eInline) {
+            SetViewportAndScissor(cmd);
+        }
+    }
+
+    vk::CommandBuffer Engine::BeginSecondary(Perframe &perframe, size_t slot) {
+        assert(slot < perframe.secondaryCommandBuffers.size());
+        vk::CommandBuffer cmd = perframe.secondaryCommandBuffers[slot];
+
+        vk::CommandBufferInheritanceInfo inheritance {
+            _renderPass,
+            0,
+            perframe.framebuffers[perframe.imageIndex]
+        };
+        vk::CommandBufferBeginInfo beginInfo {
+            vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+            &inheritance
+        };
+        VK_CHECK(cmd.begin(beginInfo));
+
+        SetViewportAndScissor(cmd);
+        return cmd;
+    }
+
+    void Engine::SetViewportAndScissor(vk::CommandBuffer cmd) {
         vk::Viewport vp {
             0.0f, 0.0f, 
             static_cast<float>(_swapchainDimensions.width), static_cast<float>(_swapchainDimensions.height),
@@ -947,35 +1622,49 @@ namespace Graphics {
 
     void Engine::EndRenderPass() {
         currentPerframe->primaryCommandBuffer.endRenderPass();
+        _renderPassActive = false;
     }
 
     // Returns nullptr if the frame isn't ready yet
     Perframe* Engine::BeginFrame() {
         currentPerframe = nullptr;
 
-        uint32_t index;
-        vk::Result res = AcquireNextImage(&index);
+        // Frames rotate through the ring regardless of which swapchain image comes back.
+        Perframe &perframe = _perframes[_currentFrame % _perframes.size()];
+        vk::Result res = AcquireNextImage(perframe);
 
         switch(res) {
-            case vk::Result::eSuboptimalKHR:
             case vk::Result::eErrorOutOfDateKHR:
                 Resize();
                 return nullptr;
             case vk::Result::eSuccess:
+                // A suboptimal image is still usable, the swapchain gets rebuilt after presenting it.
                 break;
             default:
                 return nullptr;
         }
 
-        // Begin render pass
-        auto cmd = _perframes[index].primaryCommandBuffer;
+        // Before streaming, which may generate mips with the frame's descriptors.
+        perframe.descriptorAllocator.Reset();
+        _recordingFrame = &perframe;
+
+        PollStreaming();
+        EnforceMemoryBudget();
+        PollPipelines();
+
+        // The render pass is begun lazily, so compute work can be recorded ahead of it.
+        auto cmd = perframe.primaryCommandBuffer;
 
         vk::CommandBufferBeginInfo beginInfo {vk::CommandBufferUsageFlagBits::eOneTimeSubmit};
         VK_CHECK(cmd.begin(beginInfo));
 
-        currentPerframe = &_perframes[index];
+        // The fence has signaled, so last use of this frame's uniform region is done.
+        frameAllocator.Reset(perframe.perframeIndex);
+        perframe.objectCount = 0;
+        perframe.sceneUploadCount = 0;
+        perframe.drawCommandCount = 0;
 
-        BeginRenderPass();
+        currentPerframe = &perframe;
 
         return currentPerframe;
     }
@@ -984,27 +1673,34 @@ namespace Graphics {
         auto perframe = currentPerframe;
         auto cmd = perframe->primaryCommandBuffer;
 
+        // Still clears the frame when nothing was drawn.
+        if (!_renderPassActive) {
+            BeginRenderPass();
+        }
         EndRenderPass();
 
         VK_CHECK(cmd.end());
 
-        // If the perframe release semaphore wasn't created yet, initialize it now.
-        if (!perframe->swapchainReleaseSemaphore) {
-            vk::Result result;
-            std::tie(result, perframe->swapchainReleaseSemaphore) = _device.createSemaphore({});
-            VK_CHECK(result);
+        // One flush for everything written this frame, no-op on coherent memory.
+        frameAllocator.Flush();
+        if (perframe->objectCount > 0) {
+            VK_CHECK(_allocator.flushAllocation(perframe->objectBuffer.allocation, 0, perframe->objectCount * sizeof(GPUObjectData)));
+        }
+        if (perframe->sceneUploadCount > 0) {
+            VK_CHECK(_allocator.flushAllocation(perframe->sceneUploadBuffer.allocation, 0, perframe->sceneUploadCount * sizeof(GPUCullObject)));
+        }
+        if (perframe->drawCommandCount > 0) {
+            VK_CHECK(_allocator.flushAllocation(perframe->drawCommandBuffer.allocation, 0, perframe->drawCommandCount * sizeof(vk::DrawIndexedIndirectCommand)));
         }
 
-        vk::PipelineStageFlags waitStage {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-
-        vk::SubmitInfo info {
-            perframe->swapchainAcquireSemaphore, // Wait Semaphores
-            waitStage, // Wait Stage Mask
-            perframe->primaryCommandBuffer, // Command Buffer 
-            perframe->swapchainReleaseSemaphore // Signal Semaphores
-        };
+        SubmitFrame(*perframe);
 
-        VK_CHECK(_queue.submit(info, perframe->queueSubmitFence));
+        if (_config.headless) {
+            // Nothing to present, the frame stays in its offscreen image.
+            _lastImageIndex = perframe->imageIndex;
+            _currentFrame++;
+            return;
+        }
 
         vk::Result res = Present(perframe);
 
@@ -1028,21 +1724,7 @@ namespace Graphics {
 
         VK_CHECK(cmd.end());
 
-        if (!perframe->swapchainReleaseSemaphore) {
-            vk::Result result;
-            std::tie(result, perframe->swapchainReleaseSemaphore) = _device.createSemaphore({});
-            VK_CHECK(result);
-        }
-
-        vk::PipelineStageFlags waitStage {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-
-        vk::SubmitInfo info {
-            perframe->swapchainAcquireSemaphore,
-            waitStage, perframe->primaryCommandBuffer,
-            perframe->swapchainReleaseSemaphore
-        };
-
-        VK_CHECK(_queue.submit(info, perframe->queueSubmitFence));
+        SubmitFrame(*perframe);
 
         vk::Result res = Present(perframe);
 
@@ -1059,56 +1741,44 @@ namespace Graphics {
         _currentFrame++;
     }
 
-    vk::Result Engine::AcquireNextImage(uint32_t *image) {
+    vk::Result Engine::AcquireNextImage(Perframe &perframe) {
         vk::Result result;
-        vk::Semaphore acquireSemaphore;
-
-        if (_recycledSemaphores.empty()) {
-            std::tie(result, acquireSemaphore) = _device.createSemaphore({});
-            VK_CHECK(result);
-        } else {
-            acquireSemaphore = _recycledSemaphores.back();
-            _recycledSemaphores.pop_back();
-        }
-
-        std::tie(result, *image) = _device.acquireNextImageKHR(_swapchain, UINT64_MAX, acquireSemaphore);
-
-        if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
-            _recycledSemaphores.push_back(acquireSemaphore);
-            return result;
-        }
 
-        // If we have outstanding fences for this swapchain image, wait for them to complete first.
-        // After begin frame returns, it is safe to reuse or delete resources which
-        // were used previously.
+        // Wait for the GPU to finish the last frame that used this slot of the ring.
+        // After this returns it is safe to reuse or delete the frame's resources.
         //
-        // We wait for fences which completes N frames earlier, so we do not stall,
-        // waiting for all GPU work to complete before this returns.
-        // Normally, this doesn't really block at all,
-        // since we're waiting for old frames to have been completed, but just in case.
-        if (_perframes[*image].queueSubmitFence) {
-            VK_CHECK(_device.waitForFences(_perframes[*image].queueSubmitFence, true, UINT64_MAX));
-            VK_CHECK(_device.resetFences(_perframes[*image].queueSubmitFence));
-        }
+        // The fence belongs to a frame submitted framesInFlight frames ago, so normally
+        // this doesn't block at all unless the CPU is running that far ahead.
+        VK_CHECK(_device.waitForFences(perframe.queueSubmitFence, true, UINT64_MAX));
 
-        if (_perframes[*image].primaryCommandPool)
-        {
-            VK_CHECK(_device.resetCommandPool(_perframes[*image].primaryCommandPool));
+        if (_config.headless) {
+            // Each frame in flight owns its offscreen image.
+            perframe.imageIndex = perframe.perframeIndex;
+        } else {
+            std::tie(result, perframe.imageIndex) = _device.acquireNextImageKHR(
+                _swapchain,
+                UINT64_MAX,
+                perframe.swapchainAcquireSemaphore
+            );
+
+            // Leave the fence signaled, nothing will be submitted for this frame.
+            if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
+                return result;
+            }
         }
 
-        // Release semaphore back into the manager
-        vk::Semaphore oldSemaphore = _perframes[*image].swapchainAcquireSemaphore;
-        if (oldSemaphore) {
-            _recycledSemaphores.push_back(oldSemaphore);
+        VK_CHECK(_device.resetFences(perframe.queueSubmitFence));
+        VK_CHECK(_device.resetCommandPool(perframe.primaryCommandPool));
+        for (auto pool : perframe.secondaryCommandPools) {
+            VK_CHECK(_device.resetCommandPool(pool));
         }
 
-        _perframes[*image].swapchainAcquireSemaphore = acquireSemaphore;
         return vk::Result::eSuccess;
     }
 
     vk::Result Engine::Present(Perframe *perframe) {
         vk::PresentInfoKHR present {
-            perframe->swapchainReleaseSemaphore, _swapchain, perframe->perframeIndex
+            _swapchainReleaseSemaphores[perframe->imageIndex], _swapchain, perframe->imageIndex
         };
         // Avoid assertion failure on result because we want to
         // bypass assert check on vk::Result::eOutdated and handle manually
@@ -1116,7 +1786,7 @@ namespace Graphics {
     }
 
     void Engine::Resize() {
-        if (!_device) {
+        if (!_device || _config.headless) {
             return;
         }
 
@@ -1131,13 +1801,10 @@ namespace Graphics {
 
         VK_CHECK(_device.waitIdle());
 
-        _device.destroyImageView(_depthImageView);
-        _allocator.destroyImage(_depthImage.image, _depthImage.allocation);
-
+        // Frames in flight don't depend on the swapchain, only their attachments do.
         TeardownFramebuffers();
         InitSwapchain();
         InitFramebuffers();
-        InitDescriptors();
     }
 
     void Engine::WaitIdle() {
@@ -1146,10 +1813,18 @@ namespace Graphics {
 
     void Engine::TeardownFramebuffers() {
         VK_CHECK(_queue.waitIdle());
-        for(auto &framebuffer : _swapchainFramebuffers) {
-            _device.destroyFramebuffer(framebuffer);
+        for(auto &perframe : _perframes) {
+            for(auto &framebuffer : perframe.framebuffers) {
+                _device.destroyFramebuffer(framebuffer);
+            }
+            perframe.framebuffers.clear();
+
+            _device.destroyImageView(perframe.depthImageView);
+            perframe.depthImageView = nullptr;
+
+            _allocator.destroyImage(perframe.depthImage.image, perframe.depthImage.allocation);
+            perframe.depthImage = {};
         }
-        _swapchainFramebuffers.clear();
     }
 
     AllocatedBuffer Engine::CreateBuffer(
@@ -1157,7 +1832,8 @@ namespace Graphics {
         vk::BufferUsageFlags bufferUsage,
         vma::AllocationCreateFlags preferredFlags,
         vk::MemoryPropertyFlags requiredFlags,
-        vma::MemoryUsage memoryUsage
+        vma::MemoryUsage memoryUsage,
+        bool sharedWithTransfer
     ) {
         AllocatedBuffer buffer;
 
@@ -1167,6 +1843,12 @@ namespace Graphics {
         bufferCreateInfo.usage = bufferUsage;
         bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
 
+        uint32_t families[] = {_graphicsQueueIndex, _transferQueueIndex};
+        if (sharedWithTransfer && _transferQueueIndex != _graphicsQueueIndex) {
+            bufferCreateInfo.sharingMode = vk::SharingMode::eConcurrent;
+            bufferCreateInfo.setQueueFamilyIndices(families);
+        }
+
         vma::AllocationCreateInfo allocationCreateInfo {};
         allocationCreateInfo.flags = preferredFlags;
         allocationCreateInfo.usage = memoryUsage;
@@ -1183,42 +1865,269 @@ namespace Graphics {
         return buffer;
     }
 
-    AllocatedImage Engine::CreateImage(vk::Format format, vk::Extent3D extent, vk::ImageUsageFlags usage) {
+    static bool IsBlockCompressed(vk::Format format) {
+        return format >= vk::Format::eBc1RgbUnormBlock && format <= vk::Format::eBc7SrgbBlock;
+    }
+
+    AllocatedImage Engine::CreateImage(vk::Format format, vk::Extent3D extent, vk::ImageUsageFlags usage, uint32_t mipLevels, bool sharedWithTransfer) {
         vma::AllocationCreateInfo allocInfo {};
         AllocatedImage image;
         allocInfo.usage = vma::MemoryUsage::eAuto;
 
+        // GenerateMips reads level 0 back, by blitting if the format allows it and
+        // otherwise in a compute shader writing through a storage view.
+        vk::ImageCreateFlags flags;
+        if (mipLevels > 1 && !IsBlockCompressed(format)) {
+            if (CanBlitMips(format)) {
+                usage |= vk::ImageUsageFlagBits::eTransferSrc;
+            } else if (GetMipStorageFormat(format) != vk::Format::eUndefined) {
+                usage |= vk::ImageUsageFlagBits::eStorage;
+                flags = vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
+            } else {
+                LOGW("Can't generate mips for {} images, using a single level", vk::to_string(format));
+                mipLevels = 1;
+            }
+        }
+
         vk::ImageCreateInfo imageInfo {
-            {},
+            flags,
             vk::ImageType::e2D,
             format,
             extent,
-            1,
+            mipLevels,
             1,
             vk::SampleCountFlagBits::e1,
             vk::ImageTiling::eOptimal,
             usage
         };
 
+        uint32_t families[] = {_graphicsQueueIndex, _transferQueueIndex};
+        if (sharedWithTransfer && _transferQueueIndex != _graphicsQueueIndex) {
+            imageInfo.sharingMode = vk::SharingMode::eConcurrent;
+            imageInfo.setQueueFamilyIndices(families);
+        }
+
         auto [result, pair] = _allocator.createImage(imageInfo, allocInfo, &image.allocInfo);
         VK_CHECK(result);
         image.image = pair.first;
         image.allocation = pair.second;
         image.format = format;
         image.extent = extent;
+        image.mipLevels = mipLevels;
 
         return image;
     }
 
-    vk::ShaderModule Engine::LoadShaderModule(const char *path) {
-        auto spirv = ReadFile(path);
-        vk::ShaderModuleCreateInfo moduleInfo(
-            {}, 
-            static_cast<size_t>(spirv.size()), 
-            reinterpret_cast<const uint32_t *>(spirv.data())
-        );
+    bool Engine::CanSampleFormat(vk::Format format) {
+        vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eTransferDst;
+        vk::FormatProperties properties = _physicalDevice.getFormatProperties(format);
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    bool Engine::CanBlitMips(vk::Format format) {
+        vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eBlitSrc |
+                                          vk::FormatFeatureFlagBits::eBlitDst |
+                                          vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        vk::FormatProperties properties = _physicalDevice.getFormatProperties(format);
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    vk::Format Engine::GetMipStorageFormat(vk::Format format) {
+        // mip.comp writes rgba8, sRGB images get an unorm view and are encoded in the shader.
+        if (format != vk::Format::eR8G8B8A8Srgb && format != vk::Format::eR8G8B8A8Unorm) {
+            return vk::Format::eUndefined;
+        }
+        vk::FormatProperties properties = _physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Unorm);
+        if (!(properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage)) {
+            return vk::Format::eUndefined;
+        }
+        return vk::Format::eR8G8B8A8Unorm;
+    }
+
+    static void LevelBarrier(vk::CommandBuffer cmd, vk::Image image, uint32_t baseLevel, uint32_t levelCount,
+                             vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess, vk::ImageLayout oldLayout,
+                             vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess, vk::ImageLayout newLayout) {
+        vk::ImageMemoryBarrier barrier {
+            srcAccess,
+            dstAccess,
+            oldLayout,
+            newLayout,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            image,
+            {vk::ImageAspectFlagBits::eColor, baseLevel, levelCount, 0, 1}
+        };
+        cmd.pipelineBarrier(srcStage, dstStage, {}, {}, {}, barrier);
+    }
+
+    void Engine::GenerateMips(const AllocatedImage &image) {
+        vk::CommandBuffer cmd = _uploadContext.GetCommandBuffer();
+        int32_t width = static_cast<int32_t>(image.extent.width);
+        int32_t height = static_cast<int32_t>(image.extent.height);
+
+        if (image.mipLevels == 1 || CanBlitMips(image.format)) {
+            // Each level is blitted from the one before it, which is done with
+            // as soon as that blit is.
+            for (uint32_t level = 1; level < image.mipLevels; level++) {
+                int32_t nextWidth = std::max(width / 2, 1);
+                int32_t nextHeight = std::max(height / 2, 1);
+
+                LevelBarrier(cmd, image.image, level - 1, 1,
+                    vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+                    vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal);
+
+                vk::ImageBlit blit {};
+                blit.srcSubresource = vk::ImageSubresourceLayers {vk::ImageAspectFlagBits::eColor, level - 1, 0, 1};
+                blit.srcOffsets[1] = vk::Offset3D {width, height, 1};
+                blit.dstSubresource = vk::ImageSubresourceLayers {vk::ImageAspectFlagBits::eColor, level, 0, 1};
+                blit.dstOffsets[1] = vk::Offset3D {nextWidth, nextHeight, 1};
+                cmd.blitImage(
+                    image.image, vk::ImageLayout::eTransferSrcOptimal,
+                    image.image, vk::ImageLayout::eTransferDstOptimal,
+                    blit,
+                    vk::Filter::eLinear
+                );
+
+                LevelBarrier(cmd, image.image, level - 1, 1,
+                    vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal,
+                    vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+                width = nextWidth;
+                height = nextHeight;
+            }
+
+            LevelBarrier(cmd, image.image, image.mipLevels - 1, 1,
+                vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+                vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+            return;
+        }
+
+        // Compute fallback, one dispatch per level. CreateImage made sure a storage format exists.
+        vk::Result result;
+        uint32_t passes = image.mipLevels - 1;
+        vk::Format storageFormat = GetMipStorageFormat(image.format);
+
+        // Mips streamed in during a frame use its transient sets. Otherwise, such as
+        // while loading, they get a pool of their own released with the upload.
+        vk::DescriptorPool pool;
+        std::vector<vk::DescriptorSet> sets;
+        if (_recordingFrame) {
+            for (uint32_t i = 0; i < passes; i++) {
+                sets.push_back(AllocateFrameDescriptor(*_recordingFrame, _mipSetLayout));
+            }
+        } else {
+            std::vector<vk::DescriptorPoolSize> sizes = {
+                { vk::DescriptorType::eCombinedImageSampler, passes },
+                { vk::DescriptorType::eStorageImage, passes }
+            };
+            std::tie(result, pool) = _device.createDescriptorPool({{}, passes, sizes});
+            VK_CHECK(result);
+
+            std::vector<vk::DescriptorSetLayout> layouts(passes, _mipSetLayout);
+            std::tie(result, sets) = _device.allocateDescriptorSets({pool, layouts});
+            VK_CHECK(result);
+        }
+
+        std::vector<vk::ImageView> views;
+        auto createLevelView = [&](uint32_t level, vk::Format format, vk::ImageUsageFlags usage) {
+            // The image's usage includes storage, which a view in its own format may not support.
+            vk::ImageViewUsageCreateInfo usageInfo {usage};
+            vk::ImageViewCreateInfo viewInfo {
+                {},
+                image.image,
+                vk::ImageViewType::e2D,
+                format,
+                {},
+                {vk::ImageAspectFlagBits::eColor, level, 1, 0, 1}
+            };
+            viewInfo.pNext = &usageInfo;
+
+            vk::ImageView view;
+            std::tie(result, view) = _device.createImageView(viewInfo);
+            VK_CHECK(result);
+            views.push_back(view);
+            return view;
+        };
+
+        LevelBarrier(cmd, image.image, 0, 1,
+            vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+            vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+        LevelBarrier(cmd, image.image, 1, passes,
+            vk::PipelineStageFlagBits::eTransfer, {}, vk::ImageLayout::eTransferDstOptimal,
+            vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral);
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, _mipPipeline);
+
+        for (uint32_t level = 1; level < image.mipLevels; level++) {
+            int32_t nextWidth = std::max(width / 2, 1);
+            int32_t nextHeight = std::max(height / 2, 1);
+            vk::DescriptorSet set = sets[level - 1];
+
+            vk::DescriptorImageInfo srcInfo {_mipSampler, createLevelView(level - 1, image.format, vk::ImageUsageFlagBits::eSampled), vk::ImageLayout::eShaderReadOnlyOptimal};
+            vk::DescriptorImageInfo dstInfo {{}, createLevelView(level, storageFormat, vk::ImageUsageFlagBits::eStorage), vk::ImageLayout::eGeneral};
+            std::array<vk::WriteDescriptorSet, 2> writes = {
+                vk::WriteDescriptorSet {set, 0, 0, vk::DescriptorType::eCombinedImageSampler, srcInfo},
+                vk::WriteDescriptorSet {set, 1, 0, vk::DescriptorType::eStorageImage, dstInfo}
+            };
+            _device.updateDescriptorSets(writes, {});
+
+            GPUMipConstants constants;
+            constants.srcSize = glm::ivec2 {width, height};
+            constants.dstSize = glm::ivec2 {nextWidth, nextHeight};
+            constants.srgb = storageFormat != image.format;
+
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _mipPipelineLayout, 0, set, {});
+            cmd.pushConstants(_mipPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(GPUMipConstants), &constants);
+            cmd.dispatch((nextWidth + 7) / 8, (nextHeight + 7) / 8, 1);
+
+            LevelBarrier(cmd, image.image, level, 1,
+                vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral,
+                vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+                vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+            width = nextWidth;
+            height = nextHeight;
+        }
+
+        vk::Device device = _device;
+        _uploadContext.Defer([device, pool, views]() {
+            for (vk::ImageView view : views) {
+                device.destroyImageView(view);
+            }
+            if (pool) device.destroyDescriptorPool(pool);
+        });
+    }
+
+    vk::ShaderModule Engine::LoadShaderModule(const char *name) {
+        auto it = _shaderModules.find(name);
+        if (it != _shaderModules.end()) {
+            return it->second;
+        }
+
+        // Packed SPIR-V is created straight from the mapping, no copy.
+        vk::ShaderModuleCreateInfo moduleInfo {};
+        std::vector<char> spirv;
+        auto packed = _shaderPack.shaders.find(name);
+        if (packed != _shaderPack.shaders.end()) {
+            moduleInfo.codeSize = packed->second.size;
+            moduleInfo.pCode = packed->second.code;
+        } else {
+            std::filesystem::path path = std::filesystem::path(_config.shaderPackPath).parent_path() / (std::string(name) + ".spv");
+            std::error_code error;
+            if (!std::filesystem::is_regular_file(path, error)) {
+                LOGE("Shader {} is neither in the pack nor at {}", name, path.string());
+                return {};
+            }
+
+            spirv = ReadFile(path.string());
+            moduleInfo.codeSize = spirv.size();
+            moduleInfo.pCode = reinterpret_cast<const uint32_t *>(spirv.data());
+        }
+
         auto [result, mod] = _device.createShaderModule(moduleInfo);
         VK_CHECK(result);
+        _shaderModules[name] = mod;
         return mod;
     }
 
@@ -1232,14 +2141,123 @@ namespace Graphics {
         return alignedSize;
     }
 
-    Material* Engine::CreateMaterial(vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string& name) {
+    Material* Engine::CreateMaterial(vk::Pipeline pipeline, vk::Pipeline compactPipeline, vk::PipelineLayout layout, const std::string& name) {
+        if (!compactPipeline) {
+            LOGW("Material {} has no CompactVertex pipeline, loaded meshes won't draw with it", name);
+        }
+
+        auto existing = _materials.find(name);
+        if (existing != _materials.end()) {
+            ReleaseMaterialPipelines(existing->second);
+            _materialJobs.erase(&existing->second);
+        }
+        _pipelineRegistry.Retain(pipeline);
+        _pipelineRegistry.Retain(compactPipeline);
+
         Material mat;
         mat.pipeline = pipeline;
+        mat.compactPipeline = compactPipeline;
         mat.pipelineLayout = layout;
+
+        // Every material samples the same array, the texture comes with the object.
+        if (_bindless) {
+            mat.textureDescriptor = _bindlessSet;
+        }
         _materials[name] = mat;
         return &_materials[name];
     }
 
+    Material* Engine::CreateMaterialAsync(const std::string &name, const PipelineBuilder &builder, const PipelineBuilder &compactBuilder) {
+        // Stand in for the default material until the real pipelines are published.
+        Material *fallback = GetMaterial("default");
+        Material *material = CreateMaterial(fallback->pipeline, fallback->compactPipeline, fallback->pipelineLayout, name);
+        material->state = AssetState::Loading;
+
+        auto job = std::make_shared<PipelineJob>();
+        job->name = name;
+        job->material = material;
+        job->builders[static_cast<size_t>(VertexFormat::Full)] = builder;
+        job->builders[static_cast<size_t>(VertexFormat::Compact)] = compactBuilder;
+        _materialJobs[material] = job;
+
+        {
+            std::lock_guard<std::mutex> lock {_pipelineMutex};
+            _compilingCount++;
+        }
+
+        // Drivers compile independent pipelines in parallel, and the cache is
+        // internally synchronized.
+        for (size_t i = 0; i < 2; i++) {
+            jobs.Submit([this, job, i]() {
+                std::tie(job->results[i], job->pipelines[i]) = _pipelineRegistry.Acquire(job->builders[i]);
+                if (--job->remaining > 0) return;
+
+                std::lock_guard<std::mutex> lock {_pipelineMutex};
+                _compiledJobs.push_back(job);
+                _compilingCount--;
+                _pipelineCompiled.notify_all();
+            });
+        }
+
+        return material;
+    }
+
+    void Engine::PollPipelines() {
+        std::vector<std::shared_ptr<PipelineJob>> compiled;
+        {
+            std::lock_guard<std::mutex> lock {_pipelineMutex};
+            compiled.swap(_compiledJobs);
+        }
+
+        for (auto &job : compiled) {
+            Material *material = job->material;
+            bool succeeded = job->results[0] == vk::Result::eSuccess && job->results[1] == vk::Result::eSuccess;
+
+            // Nothing drew with the job's pipelines yet, they can go right away.
+            auto current = _materialJobs.find(material);
+            if (current == _materialJobs.end() || current->second != job) {
+                for (size_t i = 0; i < 2; i++) {
+                    if (job->results[i] == vk::Result::eSuccess) _pipelineRegistry.Release(job->pipelines[i]);
+                }
+                continue;
+            }
+            _materialJobs.erase(current);
+
+            if (!succeeded) {
+                // Keeps drawing with the default material's pipelines.
+                for (size_t i = 0; i < 2; i++) {
+                    if (job->results[i] == vk::Result::eSuccess) _pipelineRegistry.Release(job->pipelines[i]);
+                }
+                material->state = AssetState::Failed;
+                LOGW("Failed to compile pipelines for material {}", job->name);
+                continue;
+            }
+
+            // The job's references pass to the material, recorded frames may still use the fallback's.
+            ReleaseMaterialPipelines(*material);
+            material->pipeline = job->pipelines[static_cast<size_t>(VertexFormat::Full)];
+            material->compactPipeline = job->pipelines[static_cast<size_t>(VertexFormat::Compact)];
+            material->pipelineLayout = job->builders[0].GetPipelineLayout();
+            material->state = AssetState::Resident;
+        }
+    }
+
+    void Engine::ReleaseMaterialPipelines(const Material &material) {
+        for (vk::Pipeline pipeline : {material.pipeline, material.compactPipeline}) {
+            _retiredResources.push_back({_currentFrame, [this, pipeline]() {
+                _pipelineRegistry.Release(pipeline);
+            }});
+        }
+    }
+
+    Material* Engine::CreateMaterialVariant(const std::string &name, const ShaderVariant &variant) {
+        Material *material = CreateMaterialAsync(name,
+            GetVariantBuilder(VertexFormat::Full, variant),
+            GetVariantBuilder(VertexFormat::Compact, variant));
+        material->variant = variant;
+        return material;
+    }
+
     Material* Engine::GetMaterial(const std::string& name) {
         auto it = _materials.find(name);
         if (it == _materials.end()) {
@@ -1267,7 +2285,8 @@ namespace Graphics {
         {
             // Allocation ended up in a mappable memory and is already mapped - write to it directly.
             if (buffer.allocInfo.pMappedData) {
-                memcpy(buffer.allocInfo.pMappedData, data, size);
+                memcpy(reinterpret_cast<char *>(buffer.allocInfo.pMappedData) + offset, data, size);
+                VK_CHECK(_allocator.flushAllocation(buffer.allocation, offset, size));
             }
             else {
                 void * dest;
@@ -1278,33 +2297,19 @@ namespace Graphics {
             }
         }
         else {
-            // Allocation ended up in non-mappable memory - need to transfer.
+            // Allocation ended up in non-mappable memory - need to transfer. The copy is
+            // batched with the other uploads and the next frame's submit waits for it.
+            StagingAllocation staging = _uploadContext.Stage(size);
+            memcpy(staging.data, data, size);
 
-            _uploadContext.Begin();
-
-            AllocatedBuffer stagingBuf = CreateBuffer(
-                size,
-                vk::BufferUsageFlagBits::eTransferSrc,
-                vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-                {},
-                vma::MemoryUsage::eAuto
-            );
-
-            char * dest = reinterpret_cast<char *>(stagingBuf.allocInfo.pMappedData) + offset;
-            memcpy(dest, data, size);
-
-            vk::BufferCopy bufCopy = { 0, 0, size };
-            _uploadContext.cmd.copyBuffer(stagingBuf.buffer, buffer.buffer, 1, &bufCopy);
-
-            _uploadContext.SubmitSync(_queue);
-
-            _allocator.destroyBuffer(stagingBuf.buffer, stagingBuf.allocation);
+            vk::BufferCopy bufCopy = { staging.offset, offset, size };
+            _uploadContext.GetCommandBuffer().copyBuffer(staging.buffer, buffer.buffer, 1, &bufCopy);
         }
     }
 
     void Engine::UploadImage(AllocatedImage image, void * pixels) {
 
-        vk::ImageSubresourceRange range {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+        vk::ImageSubresourceRange range {vk::ImageAspectFlagBits::eColor, 0, image.mipLevels, 0, 1};
 
         // Specify the image transformation to occur between the sides of the pipeline barrier.
         vk::ImageMemoryBarrier imageBarrierToTransfer {
@@ -1318,10 +2323,15 @@ namespace Graphics {
             range
         };
 
-        _uploadContext.Begin();
+        size_t imageSize = image.extent.width * image.extent.height * 4;
+
+        StagingAllocation staging = _uploadContext.Stage(imageSize);
+        memcpy(staging.data, pixels, imageSize);
+
+        vk::CommandBuffer cmd = _uploadContext.GetCommandBuffer();
 
         // Ensure that writes from TopOfPipe are available for read from the Transfer stage
-        _uploadContext.cmd.pipelineBarrier(
+        cmd.pipelineBarrier(
             vk::PipelineStageFlagBits::eTopOfPipe,
             vk::PipelineStageFlagBits::eTransfer,
             {},
@@ -1329,45 +2339,35 @@ namespace Graphics {
             {},
             imageBarrierToTransfer
         );
-        size_t imageSize = image.extent.width * image.extent.height * 4;
 
-        AllocatedBuffer stagingBuffer = CreateBuffer(imageSize,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-            {},
-            vma::MemoryUsage::eAuto
-        );
+        vk::BufferImageCopy copyRegion {staging.offset, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {}, image.extent};
 
-        memcpy(stagingBuffer.allocInfo.pMappedData, pixels, static_cast<size_t>(imageSize));
+        cmd.copyBufferToImage(staging.buffer, image.image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
 
-        vk::BufferImageCopy copyRegion {0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {}, image.extent};
+        // Fills in the remaining levels and leaves all of them shader readable.
+        GenerateMips(image);
+    }
 
-        _uploadContext.cmd.copyBufferToImage(stagingBuffer.buffer, image.image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+    void Engine::UploadImageLevels(AllocatedImage image, const void *data, size_t size, const std::vector<vk::BufferImageCopy> &copies) {
+        StagingAllocation staging = _uploadContext.Stage(size);
+        memcpy(staging.data, data, size);
 
-        // Specify the image transformation to occur between the sides of the pipeline barrier.
-        vk::ImageMemoryBarrier imageBarrierToReadable {
-            vk::AccessFlagBits::eTransferWrite,
-            vk::AccessFlagBits::eShaderRead,
-            vk::ImageLayout::eTransferDstOptimal,
-            vk::ImageLayout::eShaderReadOnlyOptimal,
-            {},
-            {},
-            image.image,
-            range
-        };
+        std::vector<vk::BufferImageCopy> stagedCopies = copies;
+        for (vk::BufferImageCopy &copy : stagedCopies) {
+            copy.bufferOffset += staging.offset;
+        }
 
-        _uploadContext.cmd.pipelineBarrier(
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eFragmentShader,
-            {},
-            {},
-            {},
-            imageBarrierToReadable
-        );
+        vk::CommandBuffer cmd = _uploadContext.GetCommandBuffer();
+
+        LevelBarrier(cmd, image.image, 0, image.mipLevels,
+            vk::PipelineStageFlagBits::eTopOfPipe, {}, vk::ImageLayout::eUndefined,
+            vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal);
 
-        _uploadContext.SubmitSync(_queue);
+        cmd.copyBufferToImage(staging.buffer, image.image, vk::ImageLayout::eTransferDstOptimal, stagedCopies);
 
-        DestroyBuffer(stagingBuffer);
+        LevelBarrier(cmd, image.image, 0, image.mipLevels,
+            vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+            vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
     }
 
     void Engine::DestroyBuffer(AllocatedBuffer buffer) {
@@ -1400,91 +2400,716 @@ namespace Graphics {
         for(size_t i = 0; i < count; i++) {
             const Renderable& obj = first[i];
 
-            if (obj.material != lastMaterial) {
-                cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, obj.material->pipeline);
+            if (obj.material != lastMaterial || !lastMesh || obj.mesh->format != lastMesh->format) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, obj.material->GetPipeline(obj.mesh->format));
                 lastMaterial = obj.material;
             }
 
             if (obj.mesh != lastMesh) {
                 vk::DeviceSize offset = 0;
                 cmd.bindVertexBuffers(0, 1, &obj.mesh->vertexBuffer.buffer, &offset);
+                cmd.bindIndexBuffer(obj.mesh->indexBuffer.buffer, 0, obj.mesh->indexType);
+
+                MeshPushConstants constants;
+                constants.data = glm::vec4 {0.f};
+                constants.renderMatrix = obj.mesh->dequantize;
+                cmd.pushConstants(obj.material->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(MeshPushConstants), &constants);
                 lastMesh = obj.mesh;
             }
 
-            cmd.draw(static_cast<uint32_t>(obj.mesh->vertices.size()), 1, 0, 0);
+            cmd.drawIndexed(obj.mesh->GetIndexCount(), 1, 0, 0, 0);
         }
     }
 
-    Mesh* Engine::CreateMesh(const std::string &path) {
+    Mesh* Engine::CreateMesh(const std::string &path, VertexFormat format) {
         Mesh* pMesh = GetMesh(path);
         if (pMesh != nullptr) return pMesh;
 
-        auto [result, mesh] = Mesh::FromObj(*this, path);
+        // A valid cache is already in the uploaded layout, copy it straight from the mapping.
+        IO::MappedFile cacheFile;
+        MeshCacheView cached;
+        if (LoadMeshCache(path, format, cacheFile, cached)) {
+            UploadMesh(cached.mesh, cached.vertices, cached.vertexSize, cached.indices, cached.indexSize);
+            cached.mesh.sourcePath = path;
+            cached.mesh.sourceFormat = format;
+            cached.mesh.lastUsedFrame = _currentFrame;
+            _meshes[path] = cached.mesh;
+            return &_meshes[path];
+        }
+
+        auto [result, mesh] = Mesh::FromObj(jobs, path);
         if (!result) return nullptr;
 
-        return CreateMesh(path, mesh);
+        if (format == VertexFormat::Compact) {
+            size_t fullSize = mesh.GetVertexBufferSize();
+            mesh.Compact();
+            LOGI("Compacted {} vertices from {} to {} bytes", path, fullSize, mesh.GetVertexBufferSize());
+        }
+
+        pMesh = CreateMesh(path, mesh);
+        if (!pMesh) return nullptr;
+
+        pMesh->sourcePath = path;
+        pMesh->sourceFormat = format;
+        pMesh->lastUsedFrame = _currentFrame;
+        if (!WriteMeshCache(path, *pMesh)) {
+            LOGW("Failed to write mesh cache for {}", path);
+        }
+        return pMesh;
     }
 
     Mesh* Engine::CreateMesh(const std::string &name, Mesh mesh) {
         Mesh* pMesh = GetMesh(name);
         if (pMesh != nullptr) return nullptr;
 
+        std::vector<uint16_t> shortIndices;
+        auto [indexData, indexSize] = mesh.PrepareIndices(shortIndices);
+
+        UploadMesh(mesh, mesh.GetVertexData(), mesh.GetVertexBufferSize(), indexData, indexSize);
+
+        _meshes[name] = mesh;
+
+        return &_meshes[name];
+    }
+
+    void Engine::UploadMesh(Mesh &mesh, const void *vertexData, size_t vertexSize, const void *indexData, size_t indexSize) {
         mesh.vertexBuffer = CreateBuffer(
-            mesh.vertices.size() * sizeof(Vertex), 
+            vertexSize,
             vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
             vma::AllocationCreateFlagBits::eDedicatedMemory,
             {},
             vma::MemoryUsage::eAuto
         );
 
-        UploadMemory(mesh.vertexBuffer, mesh.vertices.data(), 0, mesh.GetVertexBufferSize());
+        UploadMemory(mesh.vertexBuffer, vertexData, 0, vertexSize);
 
-        _meshes[name] = mesh;
+        mesh.indexBuffer = CreateBuffer(
+            indexSize,
+            vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vma::AllocationCreateFlagBits::eDedicatedMemory,
+            {},
+            vma::MemoryUsage::eAuto
+        );
 
-        return &_meshes[name];
+        UploadMemory(mesh.indexBuffer, indexData, 0, indexSize);
     }
 
     Texture* Engine::CreateTexture(const std::string &name, const std::string &path) {
-        vk::Result result;
-
         Texture texture;
 
         Util::LoadImageFromFile(*this, path.c_str(), texture.image);
+        InitTextureSampling(texture);
+        texture.sourcePath = path;
+        texture.lastUsedFrame = _currentFrame;
+
+        _textures[name] = texture;
+
+        return &_textures[name];
+    }
+
+    void Engine::InitTextureSampling(Texture &texture) {
+        vk::Result result;
 
         vk::ImageViewCreateInfo imageInfo {
             {},
             texture.image.image,
             vk::ImageViewType::e2D,
-            vk::Format::eR8G8B8A8Srgb
+            texture.image.format
         };
 
-        imageInfo.subresourceRange.levelCount = 1;
+        imageInfo.subresourceRange.levelCount = texture.image.mipLevels;
         imageInfo.subresourceRange.layerCount = 1;
         imageInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 
+        // Images with compute generated mips also have storage usage, which sRGB formats don't support.
+        vk::ImageViewUsageCreateInfo usageInfo {vk::ImageUsageFlagBits::eSampled};
+        imageInfo.pNext = &usageInfo;
+
         std::tie(result, texture.imageView) = _device.createImageView(imageInfo);
         VK_CHECK(result);
 
-        std::tie(result, texture.sampler) = _device.createSampler({});
+        // Trilinear minification over the whole chain, magnification stays nearest.
+        vk::SamplerCreateInfo samplerInfo {};
+        samplerInfo.minFilter = vk::Filter::eLinear;
+        samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = static_cast<float>(texture.image.mipLevels);
+
+        std::tie(result, texture.sampler) = _device.createSampler(samplerInfo);
         VK_CHECK(result);
 
-        _textures[name] = texture;
+        if (!_bindless) return;
 
-        return &_textures[name];
+        // Slots of textures replaced since may still be sampled by frames in flight,
+        // only write into fresh or retired ones.
+        if (!_freeBindlessSlots.empty()) {
+            texture.bindlessIndex = _freeBindlessSlots.back();
+            _freeBindlessSlots.pop_back();
+        } else if (_nextBindlessSlot < _bindlessCapacity) {
+            texture.bindlessIndex = _nextBindlessSlot++;
+        } else {
+            LOGW("Out of bindless texture slots, drawing a texture as the placeholder");
+            texture.bindlessIndex = 0;
+            return;
+        }
+
+        vk::DescriptorImageInfo imageInfo {texture.sampler, texture.imageView, vk::ImageLayout::eShaderReadOnlyOptimal};
+        vk::WriteDescriptorSet write {_bindlessSet, 0, texture.bindlessIndex, vk::DescriptorType::eCombinedImageSampler, imageInfo};
+        _device.updateDescriptorSets(write, {});
+    }
+
+    void Engine::ReleaseBindlessSlot(Texture &texture) {
+        if (!_bindless || texture.bindlessIndex == 0) return;
+
+        uint32_t slot = texture.bindlessIndex;
+        texture.bindlessIndex = 0;
+        _retiredResources.push_back({_currentFrame, [this, slot]() {
+            _freeBindlessSlots.push_back(slot);
+        }});
     }
 
     void Engine::BindTexture(Material* material, const std::string &name) {
-        vk::Result result;
-        Texture* texture = &_textures[name];
+        Texture &texture = _textures[name];
+        material->texture = &texture;
 
-        std::vector<vk::DescriptorSet> descriptors;
-        std::tie(result, descriptors) = _device.allocateDescriptorSets({_descriptorPool, _singleTextureSetLayout});
-        VK_CHECK(result);
-        material->textureDescriptor = descriptors[0];
+        // Objects drawn with the material carry the texture's slot, there is no set to write.
+        if (_bindless) return;
+
+        // May point at the placeholder for now, a set for the real image is swapped
+        // in whenever it lands.
+        texture.bindings.push_back({material, WriteTextureDescriptor(material, texture)});
+    }
+
+    vk::DescriptorSet Engine::WriteTextureDescriptor(Material* material, Texture &texture) {
+        material->textureDescriptor = _descriptorAllocator.Allocate(_singleTextureSetLayout);
+
+        vk::DescriptorImageInfo imageBufferInfo { texture.sampler, texture.imageView, vk::ImageLayout::eShaderReadOnlyOptimal };
+        _device.updateDescriptorSetWithTemplate(material->textureDescriptor, _textureUpdateTemplate, &imageBufferInfo);
+
+        return material->textureDescriptor;
+    }
+
+    vk::DescriptorSet Engine::AllocateFrameDescriptor(Perframe &perframe, vk::DescriptorSetLayout layout) {
+        return perframe.descriptorAllocator.Allocate(layout);
+    }
+
+    Mesh* Engine::CreateMeshAsync(const std::string &path, VertexFormat format) {
+        Mesh* pMesh = GetMesh(path);
+        if (pMesh != nullptr) return pMesh;
+
+        // The map never moves its elements, so the handle stays valid while the job runs.
+        Mesh &mesh = _meshes[path];
+        mesh = _meshes["placeholder"];
+        mesh.sourcePath = path;
+        mesh.sourceFormat = format;
+        mesh.lastUsedFrame = _currentFrame;
+        StreamIn(mesh);
+
+        return &mesh;
+    }
+
+    Texture* Engine::CreateTextureAsync(const std::string &name, const std::string &path) {
+        auto it = _textures.find(name);
+        if (it != _textures.end()) return &it->second;
+
+        Texture &texture = _textures[name];
+        texture = _textures["placeholder"];
+        texture.bindings.clear();
+        texture.sourcePath = path;
+        texture.lastUsedFrame = _currentFrame;
+        StreamIn(texture);
+
+        return &texture;
+    }
+
+    void Engine::StreamIn(Mesh &mesh) {
+        mesh.state = AssetState::Loading;
+
+        auto job = std::make_shared<StreamJob>();
+        job->path = mesh.sourcePath;
+        job->mesh = &mesh;
+        job->format = mesh.sourceFormat;
+        StartStreamJob(job);
+    }
+
+    void Engine::StreamIn(Texture &texture) {
+        texture.state = AssetState::Loading;
+
+        auto job = std::make_shared<StreamJob>();
+        job->path = texture.sourcePath;
+        job->texture = &texture;
+        StartStreamJob(job);
+    }
+
+    void Engine::MarkUsed(Mesh* mesh, Material* material) {
+        mesh->lastUsedFrame = _currentFrame;
+        if (mesh->state == AssetState::Evicted) {
+            StreamIn(*mesh);
+        }
+
+        Texture* texture = material->texture;
+        if (!texture) return;
+
+        texture->lastUsedFrame = _currentFrame;
+        if (texture->state == AssetState::Evicted) {
+            StreamIn(*texture);
+        }
+    }
+
+    size_t Engine::GetStreamingCount() {
+        std::lock_guard<std::mutex> lock {_streamMutex};
+        return _decodingCount + _decodedJobs.size() + _uploadingJobs.size();
+    }
+
+    void Engine::StartStreamJob(std::shared_ptr<StreamJob> job) {
+        {
+            std::lock_guard<std::mutex> lock {_streamMutex};
+            _decodingCount++;
+        }
 
-        vk::DescriptorImageInfo imageBufferInfo { texture->sampler, texture->imageView, vk::ImageLayout::eShaderReadOnlyOptimal };
-        vk::WriteDescriptorSet writeTextureDescriptor { material->textureDescriptor, 0, 0, vk::DescriptorType::eCombinedImageSampler, imageBufferInfo };
-        _device.updateDescriptorSets(writeTextureDescriptor, {});
+        jobs.Submit([this, job]() {
+            DecodeStreamJob(*job);
+
+            std::lock_guard<std::mutex> lock {_streamMutex};
+            _decodedJobs.push_back(job);
+            _decodingCount--;
+            _streamDecoded.notify_all();
+        });
+    }
+
+    void Engine::DecodeStreamJob(StreamJob &job) {
+        // Where the data comes from differs per asset, it all ends up in one staging buffer.
+        std::vector<std::pair<const void*, size_t>> parts;
+
+        IO::MappedFile cacheFile;
+        MeshCacheView cached;
+        std::vector<uint16_t> shortIndices;
+        std::vector<uint8_t> pixels;
+
+        if (job.mesh) {
+            if (LoadMeshCache(job.path, job.format, cacheFile, cached)) {
+                job.decodedMesh = cached.mesh;
+                parts = {{cached.vertices, cached.vertexSize}, {cached.indices, cached.indexSize}};
+            } else {
+                auto [result, mesh] = Mesh::FromObj(jobs, job.path);
+                if (!result) return;
+
+                if (job.format == VertexFormat::Compact) {
+                    mesh.Compact();
+                }
+
+                job.decodedMesh = std::move(mesh);
+                auto [indexData, indexSize] = job.decodedMesh.PrepareIndices(shortIndices);
+                parts = {{job.decodedMesh.GetVertexData(), job.decodedMesh.GetVertexBufferSize()}, {indexData, indexSize}};
+
+                if (!WriteMeshCache(job.path, job.decodedMesh)) {
+                    LOGW("Failed to write mesh cache for {}", job.path);
+                }
+            }
+            job.vertexSize = parts[0].second;
+            job.indexSize = parts[1].second;
+        } else {
+            TextureCacheView cachedTexture;
+            if (LoadTextureCache(job.path, cacheFile, cachedTexture) && CanSampleFormat(cachedTexture.format)) {
+                job.imageFormat = cachedTexture.format;
+                job.extent = cachedTexture.extent;
+                job.levelCopies = GetTextureCacheCopies(cachedTexture, 0);
+                parts = {{cachedTexture.data, cachedTexture.size}};
+            } else {
+                if (!Util::DecodeImageFile(job.path.c_str(), pixels, job.extent)) return;
+                parts = {{pixels.data(), pixels.size()}};
+            }
+        }
+
+        size_t size = 0;
+        for (auto &part : parts) {
+            size += part.second;
+        }
+
+        // VMA synchronizes internally, so workers can allocate while the main thread renders.
+        job.staging = CreateBuffer(
+            size,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+            {},
+            vma::MemoryUsage::eAuto
+        );
+
+        char *dest = reinterpret_cast<char *>(job.staging.allocInfo.pMappedData);
+        for (auto &part : parts) {
+            memcpy(dest, part.first, part.second);
+            dest += part.second;
+        }
+        VK_CHECK(_allocator.flushAllocation(job.staging.allocation, 0, size));
+
+        job.decoded = true;
+    }
+
+    void Engine::SubmitStreamJob(StreamJob &job) {
+        vk::CommandBuffer cmd = _transferContext.GetCommandBuffer();
+
+        // Destinations are shared with the graphics family, so no ownership transfer is needed.
+        if (job.mesh) {
+            job.vertexBuffer = CreateBuffer(
+                job.vertexSize,
+                vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vma::AllocationCreateFlagBits::eDedicatedMemory,
+                {},
+                vma::MemoryUsage::eAuto,
+                true
+            );
+            job.indexBuffer = CreateBuffer(
+                job.indexSize,
+                vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vma::AllocationCreateFlagBits::eDedicatedMemory,
+                {},
+                vma::MemoryUsage::eAuto,
+                true
+            );
+
+            vk::BufferCopy vertexCopy {0, 0, job.vertexSize};
+            vk::BufferCopy indexCopy {job.vertexSize, 0, job.indexSize};
+            cmd.copyBuffer(job.staging.buffer, job.vertexBuffer.buffer, vertexCopy);
+            cmd.copyBuffer(job.staging.buffer, job.indexBuffer.buffer, indexCopy);
+        } else {
+            job.image = CreateImage(
+                job.imageFormat,
+                job.extent,
+                vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+                job.levelCopies.empty() ? Util::MipLevelCount(job.extent) : static_cast<uint32_t>(job.levelCopies.size()),
+                true
+            );
+
+            vk::ImageSubresourceRange range {vk::ImageAspectFlagBits::eColor, 0, job.image.mipLevels, 0, 1};
+
+            vk::ImageMemoryBarrier toTransfer {
+                {},
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                job.image.image,
+                range
+            };
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, toTransfer);
+
+            if (job.levelCopies.empty()) {
+                vk::BufferImageCopy copyRegion {0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {}, job.extent};
+                cmd.copyBufferToImage(job.staging.buffer, job.image.image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+            } else {
+                cmd.copyBufferToImage(job.staging.buffer, job.image.image, vk::ImageLayout::eTransferDstOptimal, job.levelCopies);
+            }
+
+            // Blits and compute need a graphics queue, FinishStreamJob generates the
+            // mips from here, which also makes the image shader readable.
+        }
+
+        // The batch frees the staging buffer once the copy is done.
+        _transferContext.Adopt(job.staging);
+        job.staging = {};
+        job.batch = _transferContext.GetRecordingValue();
+    }
+
+    void Engine::FinishStreamJob(StreamJob &job) {
+        if (job.mesh) {
+            Mesh mesh = std::move(job.decodedMesh);
+            mesh.vertexBuffer = job.vertexBuffer;
+            mesh.indexBuffer = job.indexBuffer;
+            mesh.state = AssetState::Resident;
+            mesh.sourcePath = std::move(job.mesh->sourcePath);
+            mesh.sourceFormat = job.mesh->sourceFormat;
+            mesh.lastUsedFrame = job.mesh->lastUsedFrame;
+            *job.mesh = std::move(mesh);
+        } else {
+            Texture &texture = *job.texture;
+            texture.image = job.image;
+            if (job.levelCopies.empty()) {
+                GenerateMips(texture.image);
+            } else {
+                LevelBarrier(_uploadContext.GetCommandBuffer(), texture.image.image, 0, texture.image.mipLevels,
+                    vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal,
+                    vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal);
+            }
+            InitTextureSampling(texture);
+            texture.state = AssetState::Resident;
+            RebindTexture(texture);
+        }
+
+        // Now owned by the asset.
+        job.vertexBuffer = {};
+        job.indexBuffer = {};
+        job.image = {};
+
+        LOGI("Streamed in {}", job.path);
+    }
+
+    void Engine::DestroyStreamJob(StreamJob &job) {
+        DestroyBuffer(job.staging);
+        DestroyBuffer(job.vertexBuffer);
+        DestroyBuffer(job.indexBuffer);
+        _allocator.destroyImage(job.image.image, job.image.allocation);
+    }
+
+    void Engine::PollStreaming() {
+        // A graphics submit has to have waited on the upload's batch too, that's
+        // what makes the data visible to the frames drawing with it.
+        for (size_t i = 0; i < _uploadingJobs.size();) {
+            StreamJob &job = *_uploadingJobs[i];
+            if (job.batch > _streamWaitValue || !_transferContext.IsComplete(job.batch)) {
+                i++;
+                continue;
+            }
+
+            FinishStreamJob(job);
+            DestroyStreamJob(job);
+
+            std::lock_guard<std::mutex> lock {_streamMutex};
+            _uploadingJobs[i] = std::move(_uploadingJobs.back());
+            _uploadingJobs.pop_back();
+        }
+
+        // Every frame that could have bound these has been waited on by now.
+        size_t retired = 0;
+        for (auto &[frame, descriptor] : _retiredDescriptorSets) {
+            if (_currentFrame < frame + _perframes.size()) {
+                _retiredDescriptorSets[retired++] = {frame, descriptor};
+                continue;
+            }
+            _descriptorAllocator.Free(descriptor);
+        }
+        _retiredDescriptorSets.resize(retired);
+
+        retired = 0;
+        for (auto &[frame, release] : _retiredResources) {
+            if (_currentFrame < frame + _perframes.size()) {
+                _retiredResources[retired++] = {frame, std::move(release)};
+                continue;
+            }
+            release();
+        }
+        _retiredResources.resize(retired);
+
+        std::vector<std::shared_ptr<StreamJob>> decoded;
+        {
+            std::lock_guard<std::mutex> lock {_streamMutex};
+            decoded.swap(_decodedJobs);
+        }
+
+        for (auto &job : decoded) {
+            if (!job->decoded) {
+                LOGW("Failed to stream in {}, keeping the placeholder", job->path);
+                if (job->mesh) job->mesh->state = AssetState::Failed;
+                if (job->texture) job->texture->state = AssetState::Failed;
+                continue;
+            }
+
+            SubmitStreamJob(*job);
+
+            std::lock_guard<std::mutex> lock {_streamMutex};
+            _uploadingJobs.push_back(job);
+        }
+
+        // Everything decoded this frame goes out as one batch.
+        _transferContext.Submit();
+    }
+
+    void Engine::RebindTexture(Texture &texture) {
+        // Sets recorded by frames in flight can't be rewritten, replace them instead.
+        // Materials rebound to something else since are dropped.
+        size_t kept = 0;
+        for (auto [material, descriptor] : texture.bindings) {
+            if (material->textureDescriptor != descriptor) continue;
+            _retiredDescriptorSets.push_back({_currentFrame, descriptor});
+            texture.bindings[kept++] = {material, WriteTextureDescriptor(material, texture)};
+        }
+        texture.bindings.resize(kept);
+    }
+
+    void Engine::EnforceMemoryBudget() {
+        // Refreshes the budget VMA fetched through VK_EXT_memory_budget.
+        _allocator.setCurrentFrameIndex(static_cast<uint32_t>(_currentFrame));
+
+        const vk::PhysicalDeviceMemoryProperties *memoryProperties = _allocator.getMemoryProperties();
+        std::vector<vma::Budget> budgets = _allocator.getHeapBudgets();
+
+        vk::DeviceSize usage = 0;
+        vk::DeviceSize available = 0;
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+            if (!(memoryProperties->memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)) continue;
+            usage += budgets[i].usage;
+            available += budgets[i].budget;
+        }
+
+        vk::DeviceSize budget = _config.memoryBudget > 0 ? _config.memoryBudget : available / 10 * 9;
+
+        // Evicted resources still allocated are already on their way out.
+        usage -= std::min(usage, _evictingBytes);
+        if (usage <= budget) {
+            _overBudget = false;
+            return;
+        }
+
+        struct Candidate {
+            uint64_t lastUsedFrame;
+            vk::DeviceSize size;
+            Mesh *mesh;
+            Texture *texture;
+        };
+        std::vector<Candidate> candidates;
+
+        // Whatever the last frame drew is likely drawn again, evicting it would only
+        // stream it straight back in.
+        auto evictable = [this](AssetState state, const std::string &sourcePath, uint64_t lastUsedFrame) {
+            return state == AssetState::Resident && !sourcePath.empty() && lastUsedFrame + 1 < _currentFrame;
+        };
+        for (auto &[name, mesh] : _meshes) {
+            if (!evictable(mesh.state, mesh.sourcePath, mesh.lastUsedFrame)) continue;
+            vk::DeviceSize size = mesh.vertexBuffer.allocInfo.size + mesh.indexBuffer.allocInfo.size;
+            candidates.push_back({mesh.lastUsedFrame, size, &mesh, nullptr});
+        }
+        for (auto &[name, texture] : _textures) {
+            if (!evictable(texture.state, texture.sourcePath, texture.lastUsedFrame)) continue;
+            candidates.push_back({texture.lastUsedFrame, texture.image.allocInfo.size, nullptr, &texture});
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+            return a.lastUsedFrame < b.lastUsedFrame;
+        });
+
+        size_t evicted = 0;
+        for (const Candidate &candidate : candidates) {
+            if (usage <= budget) break;
+            if (candidate.mesh) {
+                Evict(*candidate.mesh);
+            } else {
+                Evict(*candidate.texture);
+            }
+            usage -= std::min(usage, candidate.size);
+            evicted++;
+        }
+
+        if (evicted > 0) {
+            LOGI("Evicted {} assets to stay within the memory budget of {} MiB", evicted, budget >> 20);
+        }
+        if (usage > budget && !_overBudget) {
+            LOGW("Over the memory budget by {} MiB with nothing left to evict", (usage - budget) >> 20);
+        }
+        _overBudget = usage > budget;
+    }
+
+    void Engine::Evict(Mesh &mesh) {
+        AllocatedBuffer vertexBuffer = mesh.vertexBuffer;
+        AllocatedBuffer indexBuffer = mesh.indexBuffer;
+        vk::DeviceSize size = vertexBuffer.allocInfo.size + indexBuffer.allocInfo.size;
+
+        // Keep the bounds, so culling still finds it where it was and it gets
+        // streamed back in once it comes into view.
+        Mesh evicted = _meshes["placeholder"];
+        evicted.aabbMin = mesh.aabbMin;
+        evicted.aabbMax = mesh.aabbMax;
+        evicted.boundingSphere = mesh.boundingSphere;
+        evicted.sourcePath = std::move(mesh.sourcePath);
+        evicted.sourceFormat = mesh.sourceFormat;
+        evicted.lastUsedFrame = mesh.lastUsedFrame;
+        evicted.state = AssetState::Evicted;
+        mesh = std::move(evicted);
+
+        _evictingBytes += size;
+        _retiredResources.push_back({_currentFrame, [this, vertexBuffer, indexBuffer, size]() {
+            DestroyBuffer(vertexBuffer);
+            DestroyBuffer(indexBuffer);
+            _evictingBytes -= size;
+        }});
+    }
+
+    void Engine::Evict(Texture &texture) {
+        AllocatedImage image = texture.image;
+        vk::ImageView imageView = texture.imageView;
+        vk::Sampler sampler = texture.sampler;
+        vk::DeviceSize size = image.allocInfo.size;
+
+        ReleaseBindlessSlot(texture);
+
+        const Texture &placeholder = _textures["placeholder"];
+        texture.image = placeholder.image;
+        texture.imageView = placeholder.imageView;
+        texture.sampler = placeholder.sampler;
+        texture.state = AssetState::Evicted;
+        RebindTexture(texture);
+
+        _evictingBytes += size;
+        _retiredResources.push_back({_currentFrame, [this, image, imageView, sampler, size]() {
+            _allocator.destroyImage(image.image, image.allocation);
+            _device.destroyImageView(imageView);
+            _device.destroySampler(sampler);
+            _evictingBytes -= size;
+        }});
+    }
+
+    void Engine::SubmitFrame(Perframe &perframe) {
+        // Uploads recorded from here on go out after this frame, its fence won't cover them.
+        _recordingFrame = nullptr;
+
+        _submitWaitSemaphores.clear();
+        _submitWaitStages.clear();
+        _submitWaitValues.clear();
+
+        if (perframe.swapchainAcquireSemaphore) {
+            _submitWaitSemaphores.push_back(perframe.swapchainAcquireSemaphore);
+            _submitWaitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            _submitWaitValues.push_back(0); // Binary, ignored
+        }
+
+        // Uploads recorded since the last frame go out ahead of it. Later frames are
+        // ordered behind this one, so each timeline value only needs waiting on once.
+        uint64_t uploadValue = _uploadContext.Submit();
+        if (uploadValue > _uploadWaitValue) {
+            _submitWaitSemaphores.push_back(_uploadContext.GetTimeline());
+            _submitWaitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+            _submitWaitValues.push_back(uploadValue);
+            _uploadWaitValue = uploadValue;
+        }
+
+        // Streamed assets only feed vertex input and texture reads, the frame's compute work can run ahead.
+        uint64_t streamValue = _transferContext.Submit();
+        if (streamValue > _streamWaitValue) {
+            _submitWaitSemaphores.push_back(_transferContext.GetTimeline());
+            _submitWaitStages.push_back(vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eFragmentShader);
+            _submitWaitValues.push_back(streamValue);
+            _streamWaitValue = streamValue;
+        }
+
+        vk::TimelineSemaphoreSubmitInfo timelineInfo {};
+        timelineInfo.setWaitSemaphoreValues(_submitWaitValues);
+
+        vk::SubmitInfo info {};
+        info.setWaitSemaphores(_submitWaitSemaphores);
+        info.setWaitDstStageMask(_submitWaitStages);
+        info.setCommandBuffers(perframe.primaryCommandBuffer);
+        if (!_config.headless) {
+            info.setSignalSemaphores(_swapchainReleaseSemaphores[perframe.imageIndex]);
+        }
+        info.pNext = &timelineInfo;
+
+        VK_CHECK(_queue.submit(info, perframe.queueSubmitFence));
+    }
+
+    void Engine::CloseStreaming() {
+        // Workers may still be decoding, they touch the allocator and the job lists.
+        std::vector<std::shared_ptr<StreamJob>> remaining;
+        {
+            std::unique_lock<std::mutex> lock {_streamMutex};
+            _streamDecoded.wait(lock, [this]() { return _decodingCount == 0; });
+            remaining.swap(_decodedJobs);
+            remaining.insert(remaining.end(), _uploadingJobs.begin(), _uploadingJobs.end());
+            _uploadingJobs.clear();
+        }
+
+        // The device is idle, nothing is using these anymore.
+        for (auto &job : remaining) {
+            DestroyStreamJob(*job);
+        }
     }
 
     std::pair<uint32_t, uint32_t> Engine::GetWindowSize() {
@@ -1494,4 +3119,48 @@ namespace Graphics {
     uint64_t Engine::GetCurrentFrame() {
         return _currentFrame;
     }
+
+    bool Engine::CaptureFrame(std::vector<uint8_t> &pixels) {
+        if (!_config.headless || _currentFrame == 0) {
+            return false;
+        }
+
+        VK_CHECK(_device.waitIdle());
+
+        AllocatedImage &image = _offscreenImages[_lastImageIndex];
+        size_t size = static_cast<size_t>(image.extent.width) * image.extent.height * 4;
+
+        AllocatedBuffer readback = CreateBuffer(
+            size,
+            vk::BufferUsageFlagBits::eTransferDst,
+            vma::AllocationCreateFlagBits::eHostAccessRandom | vma::AllocationCreateFlagBits::eMapped,
+            {},
+            vma::MemoryUsage::eAuto
+        );
+
+        vk::CommandBuffer cmd = _uploadContext.GetCommandBuffer();
+
+        // Make the render pass color writes visible to the copy.
+        vk::MemoryBarrier barrier {vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eTransferRead};
+        cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            barrier,
+            {},
+            {}
+        );
+
+        vk::BufferImageCopy copyRegion {0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {}, image.extent};
+        cmd.copyImageToBuffer(image.image, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, copyRegion);
+
+        _uploadContext.Wait(_uploadContext.Submit());
+
+        VK_CHECK(_allocator.invalidateAllocation(readback.allocation, 0, VK_WHOLE_SIZE));
+        pixels.resize(size);
+        memcpy(pixels.data(), readback.allocInfo.pMappedData, size);
+
+        DestroyBuffer(readback);
+        return true;
+    }
 };
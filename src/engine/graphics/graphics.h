@@ -2,12 +2,29 @@
 
 #include <vector>
 #include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <SDL2/SDL.h>
+
+// Where the Shaders target writes SPIR-V, set by the build.
+#ifndef OKAPI_SHADER_DIR
+#define OKAPI_SHADER_DIR "shaders"
+#endif
 #include "vulkan.h"
 #include "mesh.h"
 #include "texture.h"
 #include "renderable.h"
 #include "upload_context.h"
+#include "descriptor_allocator.h"
+#include "pipeline.h"
+#include "pipeline_registry.h"
+#include "shader_pack.h"
+#include "frame_allocator.h"
+#include "culling.h"
+#include "streaming.h"
+#include "thread_pool.h"
 
 // I don't remember what this layer does
 const std::vector<const char*> gValidationLayers = {
@@ -29,39 +46,145 @@ const std::vector<const char*> gDeviceExtensions = {
 #define SCREEN_HEIGHT 720
 
 namespace Graphics {
-    const int MAX_OBJECTS = 10000;
+
+    /**
+     * Options used to create the engine.
+     */
+    struct EngineConfig {
+        // Render into engine-owned offscreen images instead of a window swapchain.
+        // No SDL window or surface is created, so this runs without a display.
+        bool headless = false;
+
+        // Size of the offscreen images when headless.
+        uint32_t width = SCREEN_WIDTH;
+        uint32_t height = SCREEN_HEIGHT;
+
+        // How many frames the CPU may record ahead of the GPU. Independent of the
+        // swapchain image count; lower means less latency, higher more overlap.
+        uint32_t framesInFlight = 2;
+
+        // Bytes of per-frame uniform data each frame in flight can allocate.
+        size_t frameDataSize = 1 << 20;
+
+        // Size of the persistent staging ring uploads go through. Bigger uploads
+        // still work, they get a staging buffer of their own.
+        size_t stagingSize = 64 << 20;
+
+        // Objects the per-frame object buffers start out holding. They grow on demand,
+        // but presizing avoids reallocating during the first frames of a big scene.
+        size_t initialObjectCapacity = 10000;
+
+        // Worker threads for parallel work such as command recording. 0 picks one
+        // less than the hardware thread count.
+        uint32_t workerThreads = 0;
+
+        // Device local bytes the engine tries to stay under by evicting the least
+        // recently drawn assets. 0 uses 90% of what the driver reports as available.
+        size_t memoryBudget = 0;
+
+        // Sample textures out of one descriptor indexed array when the device supports
+        // it, with each object carrying its texture's slot. Materials sharing a pipeline
+        // then draw without rebinding, and share instanced draws across textures.
+        bool bindless = true;
+
+        // Slots in the bindless texture array, clamped to what the device allows.
+        uint32_t maxBindlessTextures = 4096;
+
+        // Compiled pipelines are kept here between runs, so only the first run on a
+        // device and driver pays for compiling them. Empty disables saving.
+        std::string pipelineCachePath = "pipeline.cache";
+
+        // Every shader the build compiled, packed by the Shaders target. Shaders
+        // missing from it are read from their .spv file in the same directory.
+        std::string shaderPackPath = OKAPI_SHADER_DIR "/shaders.pack";
+    };
 
     struct Perframe {
         vk::Device device;
         vk::Fence queueSubmitFence;
         vk::CommandPool primaryCommandPool;
         vk::CommandBuffer primaryCommandBuffer;
+
+        // Secondary command buffers for recording the render pass on several threads.
+        // Each has its own pool, so different slots can be recorded at the same time.
+        // The last slot is reserved for the GUI.
+        std::vector<vk::CommandPool> secondaryCommandPools;
+        std::vector<vk::CommandBuffer> secondaryCommandBuffers;
+
         vk::Semaphore swapchainAcquireSemaphore;
-        vk::Semaphore swapchainReleaseSemaphore;
 
-        // Buffer that holds a GPUCameraData to use when rendering
-        AllocatedBuffer cameraBuffer;
+        // Persistently mapped GPUObjectData array, flushed once per frame.
+        // Grown by Engine::ReserveObjects, which also rewrites objectDescriptor.
         AllocatedBuffer objectBuffer;
+        size_t objectCapacity;
+        size_t objectCount;
         vk::DescriptorSet objectDescriptor;
         vk::DescriptorSet globalDescriptor;
+
+        // GPU driven rendering. Culling reads the engine's scene object buffer, counts
+        // survivors into drawCommandBuffer and compacts them into objectBuffer for the
+        // indirect draws. Objects that changed are staged in sceneUploadBuffer and
+        // copied into the scene object buffer ahead of culling.
+        AllocatedBuffer sceneUploadBuffer;
+        size_t sceneUploadCapacity;
+        size_t sceneUploadCount;
+        AllocatedBuffer drawCommandBuffer;
+        size_t drawCommandCapacity;
+        size_t drawCommandCount;
+        vk::DescriptorSet cullDescriptor;
         uint32_t queueIndex;
 
+        // Sets that only live for the frame, see Engine::AllocateFrameDescriptor.
+        DescriptorAllocator descriptorAllocator;
+
+        // Depth attachment owned by this frame, so frames in flight never share one.
+        AllocatedImage depthImage;
+        vk::ImageView depthImageView;
+
+        /**
+         * One framebuffer per swapchain image, all using this frame's depth attachment.
+         */
+        std::vector<vk::Framebuffer> framebuffers;
+
         /**
          * Index of the Perframe in the engine's array.
          */
         uint32_t perframeIndex;
+
+        /**
+         * Index of the swapchain (or offscreen) image this frame renders into.
+         */
+        uint32_t imageIndex;
+    };
+
+    struct ObjectBufferStats {
+        // Smallest object buffer capacity across frames in flight.
+        size_t capacity;
+
+        // Most objects reserved in a single frame so far.
+        size_t highWaterMark;
     };
 
     class Engine {
 
     public:
-        AllocatedBuffer sceneParamsBuffer;
+        // Per-frame uniforms (camera, scene) are bump allocated from here and bound with dynamic offsets
+        FrameAllocator frameAllocator;
+        Jobs::ThreadPool jobs;
         SDL_Window* window;
         Perframe* currentPerframe;
 
-        Engine();
+        Engine(EngineConfig config = {});
         ~Engine();
         void Init();
+        bool IsHeadless() const { return _config.headless; }
+        bool IsBindless() const { return _bindless; }
+        bool SupportsIndirectFirstInstance() const { return _indirectFirstInstance; }
+
+        /**
+         * Most draws a single drawIndexedIndirect may issue, 1 without multiDrawIndirect.
+         */
+        uint32_t GetMaxDrawIndirectCount() const { return _maxDrawIndirectCount; }
         void Update(const std::vector<Renderable> &objects);
         uint64_t GetCurrentFrame();
         void WaitIdle();
@@ -69,11 +192,66 @@ namespace Graphics {
         Mesh* GetMesh(const std::string& name);
         AllocatedImage* GetImage(const std::string& name);
         Material* GetMaterial(const std::string& name);
-        Mesh* CreateMesh(const std::string& name);
+        Mesh* CreateMesh(const std::string& name, VertexFormat format = VertexFormat::Full);
         Mesh* CreateMesh(const std::string& name, Mesh mesh);
         Texture* CreateTexture(const std::string& name, const std::string& path);
+
+        /**
+         * Like CreateMesh and CreateTexture, but return right away. The file is decoded
+         * on a worker and uploaded on the transfer queue; until that lands the handle
+         * draws as the "placeholder" asset. Check state to see where it is.
+         */
+        Mesh* CreateMeshAsync(const std::string& path, VertexFormat format = VertexFormat::Full);
+        Texture* CreateTextureAsync(const std::string& name, const std::string& path);
+
+        /**
+         * Async assets that are neither resident nor failed yet.
+         */
+        size_t GetStreamingCount();
+
+        /**
+         * Record that mesh and material's texture are drawn this frame, so they are
+         * the last to be evicted. Evicted ones start streaming back in and draw as
+         * the placeholder until they land.
+         */
+        void MarkUsed(Mesh* mesh, Material* material);
         void BindTexture(Material* material, const std::string& name);
-        Material* CreateMaterial(vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string &name);
+
+        /**
+         * Material drawing with pipeline, and with compactPipeline for CompactVertex
+         * meshes, which is what loaded meshes are. Both use layout.
+         */
+        Material* CreateMaterial(vk::Pipeline pipeline, vk::Pipeline compactPipeline, vk::PipelineLayout layout, const std::string &name);
+
+        /**
+         * Compile builder's pipeline, and compactBuilder's for CompactVertex meshes, on
+         * the worker pool and return right away. The material draws with the default
+         * material's pipelines until both are published at the start of a frame, check
+         * IsReady to see if they are. Builders with the same state as an existing
+         * pipeline share it. Their layouts must use the engine's descriptor set layouts.
+         */
+        Material* CreateMaterialAsync(const std::string &name, const PipelineBuilder &builder, const PipelineBuilder &compactBuilder);
+
+        /**
+         * Material drawing with the engine's shaders, with variant's features turned on.
+         * Compiled in the background like CreateMaterialAsync, and materials declaring
+         * the same variant share pipelines.
+         */
+        Material* CreateMaterialVariant(const std::string &name, const ShaderVariant &variant);
+
+        /**
+         * Builder with the engine's fixed function state and layout set up for
+         * format. Add shader stages to make a material with custom shaders.
+         */
+        PipelineBuilder GetPipelineBuilder(VertexFormat format);
+
+        /**
+         * Module for the shader called name in the shader pack, such as "shader.vert",
+         * or from name.spv next to the pack if the pack has no such shader. Loaded
+         * once and kept until shutdown, so builders using the same shader have equal keys.
+         * Null, with an error logged, if neither exists.
+         */
+        vk::ShaderModule LoadShaderModule(const char *name);
         void InitGui();
         vk::Result MapMemory(vma::Allocation allocation, void **data);
         void UnmapMemory(vma::Allocation allocation);
@@ -81,29 +259,73 @@ namespace Graphics {
 
         /**
          * Write CPU data to device-local memory. If allocation is HOST_VISIBLE, map and write directly,
-         * but if not, create a staging buffer. 
+         * but if not, stage it and batch the copy. Staged copies are visible from the next frame on.
          */
         void UploadMemory(AllocatedBuffer buffer, const void * data, size_t offset, size_t size);
 
         /**
-         * Write an image to device-local memory.
+         * Write an image's first level to device-local memory and generate the rest
+         * of its mip chain from it. Batched like UploadMemory.
          */
         void UploadImage(AllocatedImage image, void * pixels);
 
+        /**
+         * Write every level of an image whose mip chain was built offline, such as a
+         * cooked texture cache. copies are relative to the start of data.
+         */
+        void UploadImageLevels(AllocatedImage image, const void *data, size_t size, const std::vector<vk::BufferImageCopy> &copies);
+
+        /**
+         * Whether textures can be created and sampled in format, for picking between
+         * a cooked, block compressed texture and its source image.
+         */
+        bool CanSampleFormat(vk::Format format);
+
+        /**
+         * sharedWithTransfer makes the resource usable from both the graphics and the
+         * transfer queue family without ownership transfers, for async uploads.
+         */
         AllocatedBuffer CreateBuffer(size_t size,
             vk::BufferUsageFlags bufferUsage,
             vma::AllocationCreateFlags preferredFlags,
             vk::MemoryPropertyFlags requiredFlags,
-            vma::MemoryUsage memoryUsage);
-        AllocatedImage CreateImage(vk::Format format, vk::Extent3D extent, vk::ImageUsageFlags usage);
+            vma::MemoryUsage memoryUsage,
+            bool sharedWithTransfer = false);
+        /**
+         * With mipLevels above 1, usage gains whatever GenerateMips needs for format.
+         * Formats it has no way of handling fall back to a single level. Block
+         * compressed formats are left alone, their levels are cooked offline.
+         */
+        AllocatedImage CreateImage(vk::Format format, vk::Extent3D extent, vk::ImageUsageFlags usage, uint32_t mipLevels = 1, bool sharedWithTransfer = false);
 
         void DestroyBuffer(AllocatedBuffer buffer);
         void DestroyDescriptorPool(vk::DescriptorPool descriptorPool);
 
+        /**
+         * Allocate a set that is only valid for perframe's frame. The frame's pools
+         * are reset as a whole once its fence has signaled, so these are never freed.
+         */
+        vk::DescriptorSet AllocateFrameDescriptor(Perframe &perframe, vk::DescriptorSetLayout layout);
+
 
         Perframe* BeginFrame();
-        void BeginRenderPass();
+
+        /**
+         * Begin the frame's render pass if it isn't already. BeginFrame leaves it closed
+         * so compute work can be recorded first; Render opens it if nothing else did.
+         * With eSecondaryCommandBuffers everything in the pass, GUI included, must be
+         * recorded into secondaries and executed from the primary.
+         */
+        void BeginRenderPass(vk::SubpassContents contents = vk::SubpassContents::eInline);
         void EndRenderPass();
+        bool IsRenderPassSecondary() const { return _renderPassActive && _renderPassContents == vk::SubpassContents::eSecondaryCommandBuffers; }
+
+        /**
+         * Begin recording the frame's secondary command buffer in slot, set up to continue
+         * the current render pass. Safe to call from any thread as long as no other thread
+         * uses the same slot. The caller ends it and executes it from the primary.
+         */
+        vk::CommandBuffer BeginSecondary(Perframe &perframe, size_t slot);
         Perframe* CurrentFrame();
         void DrawObjects(vk::CommandBuffer cmd, const Renderable* first, size_t count);
         void EndFrame(Perframe *perframe);
@@ -111,45 +333,189 @@ namespace Graphics {
         std::pair<uint32_t, uint32_t> GetWindowSize();
         size_t PadUniformBufferSize(size_t originalSize);
 
+        /**
+         * Make room for count objects in the frame's object buffer and return its mapped array.
+         * Grows the buffer geometrically if needed, so call it before objectDescriptor is bound
+         * for the frame. Previous contents are not preserved.
+         */
+        GPUObjectData* ReserveObjects(Perframe &perframe, size_t count);
+
+        /**
+         * Presize every frame's object buffer, e.g. after loading a scene. Waits for the device.
+         */
+        void ReserveObjectCapacity(size_t count);
+        ObjectBufferStats GetObjectBufferStats();
+
+        /**
+         * Make the scene object buffer, which GPU culling reads every frame, hold count
+         * objects. Growing waits for the device and drops the contents, so it returns
+         * true when every object has to be written again.
+         */
+        bool ReserveSceneObjects(size_t count);
+
+        /**
+         * Record copying objects into their slots of the scene object buffer, so only
+         * objects that changed cost anything. Must be recorded before RecordCulling.
+         */
+        void RecordSceneWrites(Perframe &perframe, const std::vector<uint32_t> &slots, const std::vector<GPUCullObject> &objects);
+
+        /**
+         * Make room for GPU culling of objectCount objects into drawCount indirect draws
+         * and return the mapped draw commands. Like ReserveObjects, call it before the
+         * frame's descriptors are bound.
+         */
+        vk::DrawIndexedIndirectCommand* ReserveDrawCommands(Perframe &perframe, size_t objectCount, size_t drawCount);
+
+        /**
+         * Record the culling dispatch over the first objectCount scene objects and the
+         * barriers making its results visible to indirect draws and vertex shaders.
+         * Must be recorded outside the render pass.
+         */
+        void RecordCulling(Perframe &perframe, const Frustum &frustum, uint32_t objectCount);
+
+        /**
+         * Copy the last rendered offscreen image into pixels as tightly packed RGBA8.
+         * Only available when headless. Waits for the device to go idle.
+         */
+        bool CaptureFrame(std::vector<uint8_t> &pixels);
+
     private:
 
+        EngineConfig _config;
+
         uint64_t _currentFrame = 0;
 
+        // Frame whose descriptor pools take transient sets, from its reset in BeginFrame
+        // until SubmitFrame. Upload batches recorded meanwhile are waited on by that
+        // frame's submit, so its fence covers them too. Null outside that window.
+        Perframe* _recordingFrame = nullptr;
+
+        bool _renderPassActive = false;
+        vk::SubpassContents _renderPassContents = vk::SubpassContents::eInline;
+
         vk::Instance _instance;
 #ifndef NDEBUG
         vk::DebugUtilsMessengerEXT _debugMessenger;
 #endif
         uint32_t _graphicsQueueIndex;
+        uint32_t _transferQueueIndex;
         vk::PhysicalDevice _physicalDevice = VK_NULL_HANDLE;
         vk::PhysicalDeviceProperties _physicalDeviceProperties;
+        bool _memoryBudgetSupported = false;
+        bool _bindless = false;
+        bool _indirectFirstInstance = false;
+        uint32_t _maxDrawIndirectCount = 1;
         vk::Device _device;
         vk::SurfaceKHR _surface;
         vk::SwapchainKHR _swapchain;
         vk::Queue _queue;
+        vk::Queue _transferQueue;
         vk::Format _swapchainFormat;
         vk::Extent2D _swapchainDimensions;
         vk::RenderPass _renderPass;
+        vk::PipelineCache _pipelineCache;
         vk::PipelineLayout _pipelineLayout;
         vk::Pipeline _pipeline;
+        vk::Pipeline _compactPipeline;
         vk::DescriptorSetLayout _globalSetLayout;
         vk::DescriptorSetLayout _objectSetLayout;
         vk::DescriptorSetLayout _singleTextureSetLayout;
-        vk::DescriptorPool _descriptorPool;
+        vk::DescriptorSetLayout _cullSetLayout;
+        vk::PipelineLayout _cullPipelineLayout;
+        vk::Pipeline _cullPipeline;
+
+        // Culling input for GPU driven rendering, shared by every frame. Device local
+        // and only written through RecordSceneWrites, which orders the copies after
+        // earlier frames' culling reads.
+        AllocatedBuffer _sceneObjectBuffer;
+        size_t _sceneObjectCapacity = 0;
+
+        vk::DescriptorSetLayout _mipSetLayout;
+        vk::PipelineLayout _mipPipelineLayout;
+        vk::Pipeline _mipPipeline;
+        vk::Sampler _mipSampler;
+        DescriptorAllocator _descriptorAllocator;
         vk::DescriptorPool _imguiPool;
+
+        // Rewrites of sets that are updated again and again, filled from the structs in
+        // the order their entries list.
+        vk::DescriptorUpdateTemplate _textureUpdateTemplate;
+        vk::DescriptorUpdateTemplate _objectUpdateTemplate;
+        vk::DescriptorUpdateTemplate _cullUpdateTemplate;
+
+        // Bindless texture array. Slot 0 is the placeholder's and is never freed,
+        // others are reused once frames in flight are done with them.
+        vk::DescriptorSetLayout _bindlessSetLayout;
+        vk::DescriptorPool _bindlessPool;
+        vk::DescriptorSet _bindlessSet;
+        uint32_t _bindlessCapacity = 0;
+        uint32_t _nextBindlessSlot = 0;
+        std::vector<uint32_t> _freeBindlessSlots;
         vk::CommandPool _commandPool;
         vma::Allocator _allocator; // AMD Vulkan memory allocator
 
         // Depth Testing 
-        vk::ImageView _depthImageView;
-        vk::Format _depthFormat;
-        AllocatedImage _depthImage;
+        vk::Format _depthFormat = vk::Format::eD32Sfloat;
 
         UploadContext _uploadContext;
 
+        // Async asset streaming. Workers push decoded jobs under _streamMutex,
+        // everything after that happens on the thread calling BeginFrame.
+        UploadContext _transferContext;
+        std::mutex _streamMutex;
+        std::condition_variable _streamDecoded;
+        size_t _decodingCount = 0;
+        std::vector<std::shared_ptr<StreamJob>> _decodedJobs;
+        std::vector<std::shared_ptr<StreamJob>> _uploadingJobs;
+
+        // Background pipeline compilation, same arrangement as streaming.
+        std::mutex _pipelineMutex;
+        std::condition_variable _pipelineCompiled;
+        size_t _compilingCount = 0;
+        std::vector<std::shared_ptr<PipelineJob>> _compiledJobs;
+
+        // Latest job for each material still compiling. Replacing the material drops
+        // its entry, and jobs without one are discarded when they finish.
+        std::unordered_map<const Material*, std::shared_ptr<PipelineJob>> _materialJobs;
+
+        // Every graphics pipeline materials use, shared by builder state. Each
+        // material holds a reference on its pipelines.
+        PipelineRegistry _pipelineRegistry;
+        std::unordered_map<std::string, vk::ShaderModule> _shaderModules;
+        IO::MappedFile _shaderPackFile;
+        ShaderPackView _shaderPack;
+
+        // Highest upload timeline values a frame submit has waited on.
+        uint64_t _uploadWaitValue = 0;
+        uint64_t _streamWaitValue = 0;
+
+        std::vector<vk::Semaphore> _submitWaitSemaphores;
+        std::vector<vk::PipelineStageFlags> _submitWaitStages;
+        std::vector<uint64_t> _submitWaitValues;
+
+        // Descriptor sets replaced while frames in flight may still use them, with
+        // the frame they were replaced on.
+        std::vector<std::pair<uint64_t, vk::DescriptorSet>> _retiredDescriptorSets;
+
+        // Resources of evicted assets, destroyed once frames in flight are done with
+        // them. Their bytes still count against the budget until then.
+        std::vector<std::pair<uint64_t, std::function<void()>>> _retiredResources;
+        vk::DeviceSize _evictingBytes = 0;
+        bool _overBudget = false;
+
+        // Color targets standing in for the swapchain images when headless.
+        std::vector<AllocatedImage> _offscreenImages;
+        uint32_t _lastImageIndex = 0;
+
+        size_t _objectHighWaterMark = 0;
+
         std::vector<Perframe> _perframes;
         std::vector<vk::ImageView> _swapchainImageViews;
-        std::vector<vk::Framebuffer> _swapchainFramebuffers;
-        std::vector<vk::Semaphore> _recycledSemaphores;
+
+        // Signaled by a frame's submit and waited on by its present, one per swapchain
+        // image. A frame's fence doesn't cover the present, but the image isn't
+        // acquired again until that present is done with it.
+        std::vector<vk::Semaphore> _swapchainReleaseSemaphores;
         std::vector<Renderable> _renderables;
         std::unordered_map<std::string, Material> _materials;
         std::unordered_map<std::string, Texture> _textures;
@@ -168,9 +534,18 @@ namespace Graphics {
         void InitPhysicalDeviceAndSurface();
         void InitLogicalDevice(const std::vector<const char *> &requiredDeviceExtensions);
         void InitSwapchain();
+        void InitOffscreenTargets();
+        void InitDepthImage(Perframe &perframe);
+        void InitPerframes();
         void InitPerframe(Perframe &perframe, uint32_t index);
-        void InitSceneBuffer();
+        void InitObjectBuffer(Perframe &perframe, size_t capacity);
+        void UpdateObjectDescriptor(Perframe &perframe);
+        void InitCullBuffers(Perframe &perframe, size_t drawCapacity);
+        void InitSceneObjectBuffer(size_t capacity);
+        void UpdateCullDescriptor(Perframe &perframe);
+        void InitFrameAllocator();
         void InitDescriptorSetLayouts();
+        void InitDescriptorUpdateTemplates();
 
         /**
          * A descriptor points shaders to data from program
@@ -178,24 +553,117 @@ namespace Graphics {
         void InitDescriptors();
 
         void InitUploadContext();
+        void InitPlaceholders();
+        /**
+         * Create texture's view and sampler, and write it into a bindless slot.
+         */
+        void InitTextureSampling(Texture &texture);
+
+        /**
+         * Give up texture's bindless slot, leaving it on the placeholder's.
+         */
+        void ReleaseBindlessSlot(Texture &texture);
         void InitPipeline();
+
+        /**
+         * Builder for the engine's shaders, with variant's features specialized in.
+         */
+        PipelineBuilder GetVariantBuilder(VertexFormat format, const ShaderVariant &variant);
+        void InitCullPipeline();
+        void InitMipPipeline();
         void InitRenderPass();
         void InitFramebuffers();
         void InitAllocator();
 
+        /**
+         * Create mesh's vertex and index buffers and fill them with data already in GPU layout.
+         */
+        void UploadMesh(Mesh &mesh, const void *vertexData, size_t vertexSize, const void *indexData, size_t indexSize);
+
+        /**
+         * Allocate a set pointing at texture and make it material's texture descriptor.
+         */
+        vk::DescriptorSet WriteTextureDescriptor(Material* material, Texture &texture);
+
+        bool CanBlitMips(vk::Format format);
+
+        /**
+         * Format of the view mip.comp writes format's levels through, eUndefined if there is none.
+         */
+        vk::Format GetMipStorageFormat(vk::Format format);
+
+        /**
+         * Record filling levels 1 and up of image from level 0 into the upload batch.
+         * Expects every level in TransferDstOptimal, leaves them all ShaderReadOnlyOptimal.
+         */
+        void GenerateMips(const AllocatedImage &image);
+
+        /**
+         * Start streaming mesh or texture in from its sourcePath. It draws as the
+         * placeholder until then.
+         */
+        void StreamIn(Mesh &mesh);
+        void StreamIn(Texture &texture);
+        void StartStreamJob(std::shared_ptr<StreamJob> job);
+
+        /**
+         * Worker side of a stream job: decode the file and fill a staging buffer with it.
+         */
+        void DecodeStreamJob(StreamJob &job);
+        void SubmitStreamJob(StreamJob &job);
+        void FinishStreamJob(StreamJob &job);
+        void DestroyStreamJob(StreamJob &job);
+
+        /**
+         * Retire finished uploads and submit newly decoded ones. Called once per frame,
+         * after the frame's fence has been waited on.
+         */
+        void PollStreaming();
+
+        /**
+         * Publish pipelines compiled since the last call into their materials.
+         */
+        void PollPipelines();
+
+        /**
+         * Drop material's registry references once frames in flight are done with them.
+         */
+        void ReleaseMaterialPipelines(const Material &material);
+
+        /**
+         * Evict the least recently drawn assets until device local usage is back
+         * under the budget. Assets drawn last frame are kept.
+         */
+        void EnforceMemoryBudget();
+        void Evict(Mesh &mesh);
+        void Evict(Texture &texture);
+
+        /**
+         * Replace the descriptor sets of materials bound to texture with sets
+         * pointing at its current image.
+         */
+        void RebindTexture(Texture &texture);
+
+        /**
+         * Submit perframe's command buffer. Pending upload batches are submitted first
+         * and waited on, along with the swapchain image if there is one.
+         */
+        void SubmitFrame(Perframe &perframe);
+
         void CloseVulkan();
+        void CloseStreaming();
         void TeardownSwapchain();
         void TeardownPerframe(Perframe &perframe);
         void TeardownDescriptors();
         void TeardownFramebuffers();
 
-        vk::Result AcquireNextImage(uint32_t *index);
+        void SetViewportAndScissor(vk::CommandBuffer cmd);
+        vk::Result AcquireNextImage(Perframe &perframe);
         vk::Result Present(Perframe *perframe);
         void Resize();
 
         vk::DebugUtilsMessengerCreateInfoEXT GetDebugUtilsMessengerCreateInfo();
         vk::PresentModeKHR ChooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes);
         vk::Extent2D ChooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities);
-        vk::ShaderModule LoadShaderModule(const char *path);
     };
 };
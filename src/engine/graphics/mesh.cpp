@@ -1,8 +1,15 @@
 #include "mesh.h"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
 #include "logging.h"
-#include "graphics.h"
+#include "obj_parser.h"
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <cstring>
+#include <limits>
 
 namespace Graphics {
 
@@ -55,6 +62,38 @@ namespace Graphics {
         return description;
     }
 
+    VertexInputDescription CompactVertex::GetInputDescription() {
+        VertexInputDescription description;
+
+        description.bindings.push_back({0, sizeof(CompactVertex), vk::VertexInputRate::eVertex});
+
+        // Same locations as Vertex, the shader sees normalized values and dequantizes.
+        description.attributes.push_back({0, 0, vk::Format::eR16G16B16A16Snorm, offsetof(CompactVertex, position)});
+        description.attributes.push_back({1, 0, vk::Format::eR16G16Snorm, offsetof(CompactVertex, normal)});
+        description.attributes.push_back({2, 0, vk::Format::eR8G8B8A8Unorm, offsetof(CompactVertex, color)});
+        description.attributes.push_back({3, 0, vk::Format::eR16G16Sfloat, offsetof(CompactVertex, uv)});
+
+        return description;
+    }
+
+    static_assert(sizeof(CompactVertex) == 20, "CompactVertex must stay tightly packed");
+
+    // Map a unit vector onto the octahedron, then unfold it into [-1, 1]^2.
+    static glm::vec2 OctEncode(glm::vec3 n) {
+        float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (sum == 0.f) return glm::vec2 {0.f};
+
+        n /= sum;
+        glm::vec2 encoded {n.x, n.y};
+        if (n.z < 0.f) {
+            encoded = glm::vec2 {
+                (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+                (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f)
+            };
+        }
+        return encoded;
+    }
+
     // Allocate buffer's data and map into GPU readable data.
     vk::Result Mesh::Allocate() {
         return vk::Result::eSuccess;
@@ -64,86 +103,307 @@ namespace Graphics {
         vertices.clear();
     }
 
-    std::pair<bool, Mesh> Mesh::FromObj(Engine& engine, const std::string &path) {
+    void Mesh::ComputeBounds() {
+        if (vertices.empty()) {
+            aabbMin = aabbMax = glm::vec3 {0.f};
+            boundingSphere = glm::vec4 {0.f};
+            return;
+        }
 
-        tinyobj::ObjReaderConfig config;
-        tinyobj::ObjReader reader;
+        // Center the sphere on the box, then grow it to reach the farthest vertex.
+        glm::vec3 min = vertices[0].position;
+        glm::vec3 max = vertices[0].position;
+        for(auto &vertex : vertices) {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
 
-        Mesh m;
+        aabbMin = min;
+        aabbMax = max;
+
+        glm::vec3 center = (min + max) * 0.5f;
+        float radiusSquared = 0.f;
+        for(auto &vertex : vertices) {
+            glm::vec3 d = vertex.position - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+        }
+
+        boundingSphere = glm::vec4 {center, std::sqrt(radiusSquared)};
+    }
+
+    void Mesh::Compact() {
+        ComputeBounds();
 
-        if (!reader.ParseFromFile(path.c_str(), config)) {
-            if (!reader.Error().empty()) {
-                LOGE(reader.Error());
+        // Positions are stored relative to the box, so precision scales with the mesh size.
+        glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+        glm::vec3 extent = (aabbMax - aabbMin) * 0.5f;
+        for (int i = 0; i < 3; i++) {
+            if (extent[i] <= 0.f) extent[i] = 1.f;
+        }
+
+        compactVertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const Vertex &vertex = vertices[i];
+            CompactVertex &compact = compactVertices[i];
+
+            glm::vec3 position = (vertex.position - center) / extent;
+            uint64_t packedPosition = glm::packSnorm4x16(glm::vec4 {position, 0.f});
+            memcpy(compact.position, &packedPosition, sizeof(compact.position));
+
+            compact.normal = glm::packSnorm2x16(OctEncode(vertex.normal));
+            compact.uv = glm::packHalf2x16(vertex.uv);
+            compact.color = glm::packUnorm4x8(glm::vec4 {glm::clamp(vertex.color, 0.f, 1.f), 1.f});
+        }
+
+        dequantize = glm::scale(glm::translate(glm::mat4 {1.f}, center), extent);
+        format = VertexFormat::Compact;
+    }
+
+    // Scoring from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+    static constexpr int VERTEX_CACHE_SIZE = 32;
+
+    static float VertexCacheScore(int cachePosition, uint32_t remainingTriangles) {
+        if (remainingTriangles == 0) return -1.f;
+
+        float score = 0.f;
+        if (cachePosition >= 0) {
+            // The last triangle's vertices score the same, whichever order they went in.
+            if (cachePosition < 3) {
+                score = 0.75f;
+            } else {
+                score = std::pow(1.f - float(cachePosition - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
             }
-            return std::pair(false, m);
         }
 
-        if (!reader.Warning().empty()) {
-            LOGW(reader.Warning());
+        // Favour finishing off vertices with few triangles left, so they leave the cache for good.
+        return score + 2.f * std::pow(float(remainingTriangles), -0.5f);
+    }
+
+    void Mesh::OptimizeVertexCache() {
+        size_t triangleCount = indices.size() / 3;
+        size_t vertexCount = vertices.size();
+        if (triangleCount == 0) return;
+
+        // Triangles using each vertex. Emitted triangles are swapped to the end
+        // of a vertex's range and dropped from its count.
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (uint32_t index : indices) {
+            remaining[index]++;
+        }
+        std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScore[v] = VertexCacheScore(-1, remaining[v]);
         }
 
-        // attrib contains the vertex arrays of the file
-        tinyobj::attrib_t attrib = reader.GetAttrib();
+        auto triangleScore = [&](uint32_t t) {
+            return vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+        };
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> optimized;
+        optimized.reserve(indices.size());
+        std::vector<uint32_t> cache;
+        std::vector<uint32_t> nextCache;
+        size_t scanStart = 0;
+
+        int64_t best = 0;
+        float bestScore = -1.f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            float score = triangleScore(static_cast<uint32_t>(t));
+            if (score > bestScore) {
+                bestScore = score;
+                best = static_cast<int64_t>(t);
+            }
+        }
 
-        // shape info for each shape
-        std::vector<tinyobj::shape_t> shapes = reader.GetShapes();
+        while (optimized.size() < indices.size()) {
+            if (best < 0) {
+                // Nothing in the cache touches a triangle that's left, start over at the next one.
+                while (emitted[scanStart]) scanStart++;
+                best = static_cast<int64_t>(scanStart);
+            }
 
-        // Information about materials for each shape
-        std::vector<tinyobj::material_t> materials = reader.GetMaterials();
+            uint32_t triangle = static_cast<uint32_t>(best);
+            const uint32_t *corners = &indices[3 * size_t(triangle)];
+            emitted[triangle] = true;
 
-        // Loop over shapes
-        for (size_t s = 0; s < shapes.size(); s++) {
-            // Loop over faces(polygon)
-            size_t indexOffset = 0;
-            for(size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-                size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t v = corners[k];
+                optimized.push_back(v);
 
-                // Loop over vertices in the face
-                for (size_t v = 0; v < fv; v++) {
-                    Vertex vertex;
+                uint32_t *first = &adjacency[adjacencyStart[v]];
+                uint32_t *last = first + remaining[v] - 1;
+                std::iter_swap(std::find(first, last + 1, triangle), last);
+                remaining[v]--;
+            }
 
-                    // access to vertex
-                    tinyobj::index_t idx = shapes[s].mesh.indices[indexOffset + v];
-                    tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-                    tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-                    tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
-                    vertex.position = { vx, vy, vz };
+            // Least recently used: the triangle's vertices go to the front.
+            nextCache.assign(corners, corners + 3);
+            for (uint32_t v : cache) {
+                if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                    nextCache.push_back(v);
+                }
+            }
+            for (size_t i = VERTEX_CACHE_SIZE; i < nextCache.size(); i++) {
+                cachePosition[nextCache[i]] = -1;
+                vertexScore[nextCache[i]] = VertexCacheScore(-1, remaining[nextCache[i]]);
+            }
+            nextCache.resize(std::min<size_t>(nextCache.size(), VERTEX_CACHE_SIZE));
+            cache.swap(nextCache);
 
-                    // check if "normal index" is 0 or positive. negative = no normal data
-                    if (idx.normal_index >= 0) {
-                        tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-                        tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-                        tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-                        vertex.normal = { nx, ny, nz };
+            for (size_t i = 0; i < cache.size(); i++) {
+                cachePosition[cache[i]] = static_cast<int>(i);
+                vertexScore[cache[i]] = VertexCacheScore(static_cast<int>(i), remaining[cache[i]]);
+            }
 
-                        vertex.color = vertex.normal;
+            // Only triangles around cached vertices changed score enough to matter.
+            best = -1;
+            bestScore = -1.f;
+            for (uint32_t v : cache) {
+                for (uint32_t i = 0; i < remaining[v]; i++) {
+                    uint32_t t = adjacency[adjacencyStart[v] + i];
+                    float score = triangleScore(t);
+                    if (score > bestScore) {
+                        bestScore = score;
+                        best = t;
                     }
+                }
+            }
+        }
 
-                    // check if "texcoord index" is 0 or positive. negative = no texcoord data
-                    if (idx.texcoord_index >= 0) {
-                        tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-                        tinyobj::real_t ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
-                    }
+        // Renumber vertices in the order the new index list first uses them.
+        constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> remap(vertexCount, UNUSED);
+        uint32_t nextVertex = 0;
+        for (uint32_t &index : optimized) {
+            if (remap[index] == UNUSED) {
+                remap[index] = nextVertex++;
+            }
+            index = remap[index];
+        }
 
-                    tinyobj::real_t red   = attrib.colors[3*size_t(idx.vertex_index)+0];
-                    tinyobj::real_t green = attrib.colors[3*size_t(idx.vertex_index)+1];
-                    tinyobj::real_t blue  = attrib.colors[3*size_t(idx.vertex_index)+2];
+        std::vector<Vertex> reordered(nextVertex);
+        for (size_t v = 0; v < vertexCount; v++) {
+            if (remap[v] != UNUSED) reordered[remap[v]] = vertices[v];
+        }
+        vertices.swap(reordered);
 
-                    // uv
-                    tinyobj::real_t ux = attrib.texcoords[2 * idx.texcoord_index + 0];
-                    tinyobj::real_t uy = attrib.texcoords[2 * idx.texcoord_index + 1];
+        if (!compactVertices.empty()) {
+            std::vector<CompactVertex> reorderedCompact(nextVertex);
+            for (size_t v = 0; v < vertexCount; v++) {
+                if (remap[v] != UNUSED) reorderedCompact[remap[v]] = compactVertices[v];
+            }
+            compactVertices.swap(reorderedCompact);
+        }
 
-                    vertex.uv.x = ux;
-                    vertex.uv.y = 1 - uy; // Vulkan specific uy manipulation
+        indices.swap(optimized);
+    }
 
-                    m.vertices.push_back(vertex);
-                }
-                indexOffset += fv;
+    std::pair<const void*, size_t> Mesh::PrepareIndices(std::vector<uint16_t> &shortIndices) {
+        // Everything draws indexed, meshes built without indices get the trivial list.
+        if (indices.empty()) {
+            indices.resize(vertices.size());
+            for (size_t i = 0; i < indices.size(); i++) {
+                indices[i] = static_cast<uint32_t>(i);
             }
         }
+        indexCount = static_cast<uint32_t>(indices.size());
+
+        // Meshes loaded from files come with bounds, ones built in code may not.
+        if (boundingSphere.w == 0.f) {
+            ComputeBounds();
+        }
+
+        // Half the index memory and bandwidth when every vertex is addressable in 16 bits.
+        if (vertices.size() <= std::numeric_limits<uint16_t>::max()) {
+            shortIndices.assign(indices.begin(), indices.end());
+            indexType = vk::IndexType::eUint16;
+            return {shortIndices.data(), shortIndices.size() * sizeof(uint16_t)};
+        }
+
+        indexType = vk::IndexType::eUint32;
+        return {indices.data(), indices.size() * sizeof(uint32_t)};
+    }
+
+    std::pair<bool, Mesh> Mesh::FromObj(Jobs::ThreadPool& jobs, const std::string &path) {
+        Mesh m;
+
+        IO::ObjData obj;
+        if (!IO::ParseObj(path, jobs, obj)) {
+            return std::pair(false, m);
+        }
+
+        // Face corners sharing position, normal and uv become one vertex. Numbering
+        // has to follow corner order, so this pass stays serial and only records
+        // which corner first produced each vertex.
+        size_t cornerCount = obj.corners.size();
+        std::unordered_map<IO::ObjCorner, uint32_t, IO::ObjCornerHash> uniqueVertices;
+        uniqueVertices.reserve(cornerCount / 2);
+        std::vector<uint32_t> firstCorner;
+        firstCorner.reserve(cornerCount / 2);
+        m.indices.resize(cornerCount);
+
+        for (size_t c = 0; c < cornerCount; c++) {
+            auto [it, inserted] = uniqueVertices.try_emplace(obj.corners[c], static_cast<uint32_t>(firstCorner.size()));
+            if (inserted) {
+                firstCorner.push_back(static_cast<uint32_t>(c));
+            }
+            m.indices[c] = it->second;
+        }
+
+        // Filling in the vertices is independent per vertex, split it across the pool.
+        m.vertices.resize(firstCorner.size());
+        const size_t vertexCount = m.vertices.size();
+        const size_t sliceCount = std::min<size_t>(jobs.GetThreadCount() + 1, (vertexCount + 4095) / 4096);
+        jobs.ParallelFor(sliceCount, [&](size_t slice) {
+            size_t first = vertexCount * slice / sliceCount;
+            size_t last = vertexCount * (slice + 1) / sliceCount;
+
+            for (size_t i = first; i < last; i++) {
+                const IO::ObjCorner &corner = obj.corners[firstCorner[i]];
+                Vertex &vertex = m.vertices[i];
+
+                const float *position = &obj.positions[3 * size_t(corner.vertex)];
+                vertex.position = { position[0], position[1], position[2] };
+
+                // negative = no normal data
+                if (corner.normal >= 0) {
+                    const float *normal = &obj.normals[3 * size_t(corner.normal)];
+                    vertex.normal = { normal[0], normal[1], normal[2] };
+                } else {
+                    vertex.normal = glm::vec3 {0.f};
+                }
+                vertex.color = vertex.normal;
+
+                if (corner.texcoord >= 0) {
+                    const float *uv = &obj.texcoords[2 * size_t(corner.texcoord)];
+                    vertex.uv.x = uv[0];
+                    vertex.uv.y = 1 - uv[1]; // Vulkan specific uy manipulation
+                } else {
+                    vertex.uv = glm::vec2 {0.f};
+                }
+            }
+        });
+
+        LOGI("Loaded {}: {} vertices from {} face corners", path, m.vertices.size(), cornerCount);
 
         if (m.Allocate() != vk::Result::eSuccess) return std::pair(false, m);
 
+        m.ComputeBounds();
+
         return std::pair(true, m);
     }
-}
\ No newline at end of file
+}
@@ -2,20 +2,28 @@
 
 #include "types.h"
 #include "vulkan.h"
+#include "thread_pool.h"
+#include <string>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
 namespace Graphics {
 
-    class Engine;
-
     struct VertexInputDescription {
         std::vector<vk::VertexInputBindingDescription> bindings;
         std::vector<vk::VertexInputAttributeDescription> attributes;
         vk::PipelineVertexInputStateCreateFlags flags;
     };
 
+    /**
+     * Vertex layout a mesh is uploaded with. Each format has its own pipeline variant.
+     */
+    enum class VertexFormat {
+        Full,
+        Compact
+    };
+
     struct Vertex {
         glm::vec3 position;
         glm::vec3 normal;
@@ -24,19 +32,102 @@ namespace Graphics {
         static VertexInputDescription GetInputDescription();
     };
 
+    /**
+     * 20 byte vertex, against 44 for Vertex.
+     */
+    struct CompactVertex {
+        int16_t position[4]; // snorm16 in the mesh bounds, see Mesh::dequantize. w is padding
+        uint32_t normal;     // Octahedral encoded, snorm16 x2
+        uint32_t uv;         // half x2
+        uint32_t color;      // unorm8 x4
+        static VertexInputDescription GetInputDescription();
+    };
+
     class Mesh {
 
     public:
         AllocatedBuffer vertexBuffer;
         std::vector<Vertex> vertices;
 
+        // Triangle list indices into vertices. Uploaded as 16 bit when every
+        // vertex fits, indexType records what the index buffer holds.
+        AllocatedBuffer indexBuffer;
+        std::vector<uint32_t> indices;
+        vk::IndexType indexType = vk::IndexType::eUint32;
+        uint32_t indexCount = 0;
+
+        // Compact meshes upload compactVertices instead of vertices. dequantize maps
+        // their snorm positions back to object space and is pushed per mesh.
+        VertexFormat format = VertexFormat::Full;
+        std::vector<CompactVertex> compactVertices;
+        glm::mat4 dequantize {1.f};
+
+        // Object space bounds, filled in by ComputeBounds.
+        // boundingSphere has the center in xyz and the radius in w.
+        glm::vec3 aabbMin {0.f};
+        glm::vec3 aabbMax {0.f};
+        glm::vec4 boundingSphere {0.f};
+
+        // Meshes from Engine::CreateMeshAsync draw as the placeholder while Loading.
+        AssetState state = AssetState::Resident;
+
+        // File the mesh was loaded from and the format it was asked for, used to
+        // stream it back in after eviction. Meshes built in code have no path and
+        // are never evicted.
+        std::string sourcePath;
+        VertexFormat sourceFormat = VertexFormat::Full;
+        uint64_t lastUsedFrame = 0;
+
         vk::Result Allocate();
         void Destroy();
-        static std::pair<bool, Mesh> FromObj(Engine& engine, const std::string &path);
+
+        /**
+         * Compute the bounding box and sphere from vertices.
+         */
+        void ComputeBounds();
+
+        /**
+         * Quantize vertices into compactVertices and switch the mesh to VertexFormat::Compact.
+         */
+        void Compact();
+
+        /**
+         * Reorder triangles so consecutive ones reuse recently transformed vertices,
+         * then number vertices in first use order so fetches walk the vertex buffer
+         * forwards. Slow enough that only the asset cooker runs it.
+         */
+        void OptimizeVertexCache();
+
+        /**
+         * Fill in what uploading needs: the trivial index list if there are no
+         * indices, bounds if there are none yet, and 16 bit indices when every
+         * vertex fits. Returns the index data to upload, which may live in shortIndices.
+         */
+        std::pair<const void*, size_t> PrepareIndices(std::vector<uint16_t> &shortIndices);
+
+        static std::pair<bool, Mesh> FromObj(Jobs::ThreadPool& jobs, const std::string &path);
 
         size_t GetVertexBufferSize() {
+            if (format == VertexFormat::Compact) {
+                return compactVertices.size() * sizeof(CompactVertex);
+            }
             return vertices.size() * sizeof(Vertex);
         }
+
+        const void* GetVertexData() const {
+            if (format == VertexFormat::Compact) {
+                return compactVertices.data();
+            }
+            return vertices.data();
+        }
+
+        /**
+         * Indices in indexBuffer. Meshes loaded from a cache keep no CPU side copy,
+         * so this doesn't read indices.
+         */
+        uint32_t GetIndexCount() const {
+            return indexCount;
+        }
     };
 
     struct MeshPushConstants {
@@ -0,0 +1,143 @@
+#include "mesh_cache.h"
+#include "atomic_file.h"
+#include "file_stamp.h"
+#include "logging.h"
+#include <cstring>
+
+namespace Graphics {
+
+    static constexpr char MESH_CACHE_MAGIC[4] = {'O', 'K', 'M', 'S'};
+
+    // Bump whenever the header, a vertex layout or the import changes.
+    static constexpr uint32_t MESH_CACHE_VERSION = 2;
+
+    // Written by okapi_cook, which also optimizes for the vertex cache.
+    static constexpr uint32_t MESH_CACHE_COOKED = 1;
+
+    struct MeshCacheHeader {
+        char magic[4];
+        uint32_t version;
+
+        // Source file the cache was built from, a mismatch means it is stale.
+        uint64_t sourceSize;
+        int64_t sourceTime;
+
+        uint32_t vertexFormat;
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexStride;
+        uint32_t flags;
+
+        float aabbMin[3];
+        float aabbMax[3];
+        float boundingSphere[4];
+        float dequantize[16];
+
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+    };
+
+    static uint32_t GetVertexStride(VertexFormat format) {
+        return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    std::string GetMeshCachePath(const std::string &sourcePath, VertexFormat format) {
+        return sourcePath + (format == VertexFormat::Compact ? ".compact.meshcache" : ".meshcache");
+    }
+
+    bool LoadMeshCache(const std::string &sourcePath, VertexFormat format, IO::MappedFile &file, MeshCacheView &view) {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!IO::GetFileStamp(sourcePath, sourceSize, sourceTime)) return false;
+
+        std::string cachePath = GetMeshCachePath(sourcePath, format);
+        if (!file.Open(cachePath)) return false;
+
+        if (file.Size() < sizeof(MeshCacheHeader)) {
+            file.Close();
+            return false;
+        }
+
+        MeshCacheHeader header;
+        memcpy(&header, file.Data(), sizeof(header));
+
+        bool valid = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                     header.version == MESH_CACHE_VERSION &&
+                     header.sourceSize == sourceSize &&
+                     header.sourceTime == sourceTime &&
+                     header.vertexFormat == static_cast<uint32_t>(format) &&
+                     header.vertexStride == GetVertexStride(format) &&
+                     (header.indexStride == sizeof(uint16_t) || header.indexStride == sizeof(uint32_t));
+
+        uint64_t vertexSize = uint64_t(header.vertexCount) * header.vertexStride;
+        uint64_t indexSize = uint64_t(header.indexCount) * header.indexStride;
+        valid = valid &&
+                header.vertexOffset + vertexSize <= file.Size() &&
+                header.indexOffset + indexSize <= file.Size();
+
+        if (!valid) {
+            LOGI("Mesh cache {} is stale, reimporting {}", cachePath, sourcePath);
+            file.Close();
+            return false;
+        }
+
+        Mesh &mesh = view.mesh;
+        mesh.format = format;
+        mesh.indexType = header.indexStride == sizeof(uint16_t) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+        mesh.indexCount = header.indexCount;
+        mesh.aabbMin = glm::vec3 {header.aabbMin[0], header.aabbMin[1], header.aabbMin[2]};
+        mesh.aabbMax = glm::vec3 {header.aabbMax[0], header.aabbMax[1], header.aabbMax[2]};
+        mesh.boundingSphere = glm::vec4 {header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]};
+        memcpy(&mesh.dequantize, header.dequantize, sizeof(header.dequantize));
+
+        view.cooked = (header.flags & MESH_CACHE_COOKED) != 0;
+        view.vertices = file.Data() + header.vertexOffset;
+        view.vertexSize = static_cast<size_t>(vertexSize);
+        view.indices = file.Data() + header.indexOffset;
+        view.indexSize = static_cast<size_t>(indexSize);
+        return true;
+    }
+
+    bool WriteMeshCache(const std::string &sourcePath, const Mesh &mesh, bool cooked) {
+        MeshCacheHeader header {};
+        if (!IO::GetFileStamp(sourcePath, header.sourceSize, header.sourceTime)) return false;
+
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexFormat = static_cast<uint32_t>(mesh.format);
+        header.vertexStride = GetVertexStride(mesh.format);
+        header.vertexCount = static_cast<uint32_t>(mesh.format == VertexFormat::Compact ? mesh.compactVertices.size() : mesh.vertices.size());
+        header.indexCount = mesh.GetIndexCount();
+        header.indexStride = mesh.indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        header.flags = cooked ? MESH_CACHE_COOKED : 0;
+        memcpy(header.aabbMin, &mesh.aabbMin, sizeof(header.aabbMin));
+        memcpy(header.aabbMax, &mesh.aabbMax, sizeof(header.aabbMax));
+        memcpy(header.boundingSphere, &mesh.boundingSphere, sizeof(header.boundingSphere));
+        memcpy(header.dequantize, &mesh.dequantize, sizeof(header.dequantize));
+
+        // Data is stored exactly as uploaded, so loading is a straight copy.
+        std::vector<uint16_t> shortIndices;
+        const void *indexData = mesh.indices.data();
+        if (header.indexStride == sizeof(uint16_t)) {
+            shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+            indexData = shortIndices.data();
+        }
+
+        size_t vertexSize = size_t(header.vertexCount) * header.vertexStride;
+        size_t indexSize = size_t(header.indexCount) * header.indexStride;
+        header.vertexOffset = sizeof(MeshCacheHeader);
+        header.indexOffset = header.vertexOffset + vertexSize;
+
+        std::string cachePath = GetMeshCachePath(sourcePath, mesh.format);
+        bool written = IO::WriteFileAtomic(cachePath, {
+            {&header, sizeof(header)},
+            {mesh.GetVertexData(), vertexSize},
+            {indexData, indexSize}
+        });
+        if (!written) return false;
+
+        LOGI("Wrote mesh cache {}", cachePath);
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "mesh.h"
+#include "mapped_file.h"
+#include <string>
+
+namespace Graphics {
+
+    /**
+     * A cached mesh ready for upload. mesh holds everything but the vertex and
+     * index data, which point into the mapped cache file in the layout the GPU
+     * buffers use.
+     */
+    struct MeshCacheView {
+        Mesh mesh;
+        const void *vertices = nullptr;
+        size_t vertexSize = 0;
+        const void *indices = nullptr;
+        size_t indexSize = 0;
+
+        // Written by okapi_cook rather than a runtime import.
+        bool cooked = false;
+    };
+
+    /**
+     * Path of the cache file for sourcePath imported in format.
+     */
+    std::string GetMeshCachePath(const std::string &sourcePath, VertexFormat format);
+
+    /**
+     * Map the cache for sourcePath if it exists, matches the current cache version
+     * and was written from the source file as it is now (size and modification time).
+     * view points into file, which must outlive it.
+     */
+    bool LoadMeshCache(const std::string &sourcePath, VertexFormat format, IO::MappedFile &file, MeshCacheView &view);
+
+    /**
+     * Write mesh, as imported from sourcePath, to its cache file. cooked marks
+     * caches from okapi_cook, which it leaves alone while they are current.
+     */
+    bool WriteMeshCache(const std::string &sourcePath, const Mesh &mesh, bool cooked = false);
+};
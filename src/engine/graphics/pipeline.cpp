@@ -1,27 +1,87 @@
 #include "pipeline.h"
 
 namespace Graphics {
+
+    template<typename T>
+    static std::vector<T> CopyArray(const T *data, uint32_t count) {
+        return data ? std::vector<T>(data, data + count) : std::vector<T>();
+    }
+
+    template<typename T>
+    static const T* PointInto(const std::vector<T> &owned) {
+        return owned.empty() ? nullptr : owned.data();
+    }
+
+    // Appends values to a key one at a time, so struct padding never ends up in it.
+    struct KeyWriter {
+        std::string &key;
+
+        template<typename T>
+        KeyWriter& operator<<(const T &value) {
+            key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            return *this;
+        }
+
+        KeyWriter& operator<<(const std::string &value) {
+            *this << value.size();
+            key.append(value);
+            return *this;
+        }
+    };
+
     PipelineBuilder::PipelineBuilder() { }
 
-    vk::ResultValue<vk::Pipeline> PipelineBuilder::Build(vk::Device device, vk::RenderPass renderPass) {
-        vk::GraphicsPipelineCreateInfo pipe {{}, _shaderStages};
+    vk::ResultValue<vk::Pipeline> PipelineBuilder::Build(vk::Device device, vk::RenderPass renderPass, vk::PipelineCache cache) const {
+        // Counts are kept as set, pointers go to the copies.
+        vk::PipelineVertexInputStateCreateInfo vertexInput = _vertexInput;
+        vertexInput.pVertexBindingDescriptions = PointInto(_vertexBindings);
+        vertexInput.pVertexAttributeDescriptions = PointInto(_vertexAttributes);
+
+        vk::PipelineColorBlendStateCreateInfo blend = _blend;
+        blend.pAttachments = PointInto(_blendAttachments);
+
+        vk::PipelineDynamicStateCreateInfo dynamic = _dynamic;
+        dynamic.pDynamicStates = PointInto(_dynamicStates);
+
+        vk::PipelineViewportStateCreateInfo viewport = _viewport;
+        viewport.pViewports = PointInto(_viewports);
+        viewport.pScissors = PointInto(_scissors);
+
+        std::vector<vk::PipelineShaderStageCreateInfo> stages = _shaderStages;
+        std::vector<vk::SpecializationInfo> specializations(stages.size());
+        for (size_t i = 0; i < stages.size(); i++) {
+            stages[i].pName = _entryPoints[i].c_str();
+            stages[i].pSpecializationInfo = nullptr;
+
+            const Specialization &specialization = _specializations[i];
+            if (!specialization.entries.empty()) {
+                specializations[i].setMapEntries(specialization.entries);
+                specializations[i].dataSize = specialization.data.size();
+                specializations[i].pData = specialization.data.data();
+                stages[i].pSpecializationInfo = &specializations[i];
+            }
+        }
+
+        vk::GraphicsPipelineCreateInfo pipe {{}, stages};
 
-        pipe.pVertexInputState = &_vertexInput;
+        pipe.pVertexInputState = &vertexInput;
         pipe.pInputAssemblyState = &_inputAssembly;
         pipe.pRasterizationState = &_rasterizer;
-        pipe.pColorBlendState = &_blend;
+        pipe.pColorBlendState = &blend;
         pipe.pMultisampleState = &_multisample;
-        pipe.pViewportState = &_viewport;
+        pipe.pViewportState = &viewport;
         pipe.pDepthStencilState = &_depthStencil;
-        pipe.pDynamicState = &_dynamic;
+        pipe.pDynamicState = &dynamic;
         pipe.renderPass = renderPass;
         pipe.layout = _layout;
 
-        return device.createGraphicsPipeline(VK_NULL_HANDLE, pipe);
+        return device.createGraphicsPipeline(cache, pipe);
     }
 
     PipelineBuilder* PipelineBuilder::SetVertexInput(vk::PipelineVertexInputStateCreateInfo info) {
         _vertexInput = info;
+        _vertexBindings = CopyArray(info.pVertexBindingDescriptions, info.vertexBindingDescriptionCount);
+        _vertexAttributes = CopyArray(info.pVertexAttributeDescriptions, info.vertexAttributeDescriptionCount);
         return this;
     }
 
@@ -37,6 +97,7 @@ namespace Graphics {
 
     PipelineBuilder* PipelineBuilder::SetColorBlendState(vk::PipelineColorBlendStateCreateInfo info) {
         _blend = info;
+        _blendAttachments = CopyArray(info.pAttachments, info.attachmentCount);
         return this;
     }
 
@@ -52,11 +113,14 @@ namespace Graphics {
 
     PipelineBuilder* PipelineBuilder::SetDynamicState(vk::PipelineDynamicStateCreateInfo info) {
         _dynamic = info;
+        _dynamicStates = CopyArray(info.pDynamicStates, info.dynamicStateCount);
         return this;
     }
 
     PipelineBuilder* PipelineBuilder::SetViewport(vk::PipelineViewportStateCreateInfo info) {
         _viewport = info;
+        _viewports = CopyArray(info.pViewports, info.viewportCount);
+        _scissors = CopyArray(info.pScissors, info.scissorCount);
         return this;
     }
 
@@ -67,11 +131,92 @@ namespace Graphics {
 
     PipelineBuilder* PipelineBuilder::AddShaderModule(vk::PipelineShaderStageCreateInfo info) {
         _shaderStages.push_back(info);
+        _entryPoints.push_back(info.pName ? info.pName : "main");
+
+        Specialization specialization;
+        if (const vk::SpecializationInfo *constants = info.pSpecializationInfo) {
+            specialization.entries = CopyArray(constants->pMapEntries, constants->mapEntryCount);
+            const uint8_t *data = static_cast<const uint8_t*>(constants->pData);
+            specialization.data = CopyArray(data, static_cast<uint32_t>(constants->dataSize));
+        }
+        _specializations.push_back(std::move(specialization));
         return this;
     }
 
     PipelineBuilder* PipelineBuilder::FlushShaderModules() {
         _shaderStages.clear();
+        _entryPoints.clear();
+        _specializations.clear();
         return this;
     }
-}
\ No newline at end of file
+
+    std::string PipelineBuilder::GetKey() const {
+        std::string key;
+        KeyWriter writer {key};
+
+        writer << static_cast<VkPipelineLayout>(_layout) << _shaderStages.size();
+        for (size_t i = 0; i < _shaderStages.size(); i++) {
+            writer << _shaderStages[i].stage << static_cast<VkShaderModule>(_shaderStages[i].module) << _entryPoints[i];
+
+            const Specialization &specialization = _specializations[i];
+            writer << specialization.entries.size();
+            for (const vk::SpecializationMapEntry &entry : specialization.entries) {
+                writer << entry.constantID << entry.offset << entry.size;
+            }
+            writer << std::string(specialization.data.begin(), specialization.data.end());
+        }
+
+        writer << _vertexBindings.size();
+        for (const vk::VertexInputBindingDescription &binding : _vertexBindings) {
+            writer << binding.binding << binding.stride << binding.inputRate;
+        }
+        writer << _vertexAttributes.size();
+        for (const vk::VertexInputAttributeDescription &attribute : _vertexAttributes) {
+            writer << attribute.location << attribute.binding << attribute.format << attribute.offset;
+        }
+
+        writer << _inputAssembly.topology << _inputAssembly.primitiveRestartEnable;
+
+        writer << _rasterizer.depthClampEnable << _rasterizer.rasterizerDiscardEnable
+               << _rasterizer.polygonMode << _rasterizer.cullMode << _rasterizer.frontFace
+               << _rasterizer.depthBiasEnable << _rasterizer.depthBiasConstantFactor
+               << _rasterizer.depthBiasClamp << _rasterizer.depthBiasSlopeFactor << _rasterizer.lineWidth;
+
+        writer << _blend.logicOpEnable << _blend.logicOp << _blend.blendConstants << _blendAttachments.size();
+        for (const vk::PipelineColorBlendAttachmentState &attachment : _blendAttachments) {
+            writer << attachment.blendEnable
+                   << attachment.srcColorBlendFactor << attachment.dstColorBlendFactor << attachment.colorBlendOp
+                   << attachment.srcAlphaBlendFactor << attachment.dstAlphaBlendFactor << attachment.alphaBlendOp
+                   << attachment.colorWriteMask;
+        }
+
+        writer << _multisample.rasterizationSamples << _multisample.sampleShadingEnable << _multisample.minSampleShading
+               << _multisample.alphaToCoverageEnable << _multisample.alphaToOneEnable;
+
+        writer << _depthStencil.depthTestEnable << _depthStencil.depthWriteEnable << _depthStencil.depthCompareOp
+               << _depthStencil.depthBoundsTestEnable << _depthStencil.stencilTestEnable
+               << _depthStencil.front.failOp << _depthStencil.front.passOp << _depthStencil.front.depthFailOp
+               << _depthStencil.front.compareOp << _depthStencil.front.compareMask << _depthStencil.front.writeMask
+               << _depthStencil.front.reference
+               << _depthStencil.back.failOp << _depthStencil.back.passOp << _depthStencil.back.depthFailOp
+               << _depthStencil.back.compareOp << _depthStencil.back.compareMask << _depthStencil.back.writeMask
+               << _depthStencil.back.reference
+               << _depthStencil.minDepthBounds << _depthStencil.maxDepthBounds;
+
+        // Viewports and scissors are dynamic here, but a builder may still set them.
+        writer << _viewport.viewportCount << _viewport.scissorCount << _viewports.size() << _scissors.size();
+        for (const vk::Viewport &viewport : _viewports) {
+            writer << viewport.x << viewport.y << viewport.width << viewport.height << viewport.minDepth << viewport.maxDepth;
+        }
+        for (const vk::Rect2D &scissor : _scissors) {
+            writer << scissor.offset.x << scissor.offset.y << scissor.extent.width << scissor.extent.height;
+        }
+
+        writer << _dynamicStates.size();
+        for (vk::DynamicState state : _dynamicStates) {
+            writer << state;
+        }
+
+        return key;
+    }
+}
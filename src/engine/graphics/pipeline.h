@@ -1,15 +1,23 @@
 #pragma once
 
-#include "graphics.h"
+#include "vulkan.h"
+#include <atomic>
+#include <string>
+#include <vector>
 
 namespace Graphics {
 
+    struct Material;
 
+    /**
+     * Collects the state of a graphics pipeline. Arrays the create infos point to are
+     * copied in, so a builder can be kept, copied and built later on another thread.
+     */
     class PipelineBuilder {
     public:
         PipelineBuilder();
 
-        vk::ResultValue<vk::Pipeline> Build(vk::Device device, vk::RenderPass renderPass);
+        vk::ResultValue<vk::Pipeline> Build(vk::Device device, vk::RenderPass renderPass, vk::PipelineCache cache = {}) const;
         PipelineBuilder* SetVertexInput(vk::PipelineVertexInputStateCreateInfo info);
         PipelineBuilder* SetRasterizer(vk::PipelineRasterizationStateCreateInfo info);
         PipelineBuilder* SetInputAssembly(vk::PipelineInputAssemblyStateCreateInfo info);
@@ -22,6 +30,14 @@ namespace Graphics {
         PipelineBuilder* AddShaderModule(vk::PipelineShaderStageCreateInfo info);
         PipelineBuilder* FlushShaderModules();
 
+        vk::PipelineLayout GetPipelineLayout() const { return _layout; }
+
+        /**
+         * The state Build uses, flattened field by field. Builders with equal keys
+         * build the same pipeline for a render pass.
+         */
+        std::string GetKey() const;
+
     private:
         vk::PipelineVertexInputStateCreateInfo _vertexInput;
         vk::PipelineInputAssemblyStateCreateInfo _inputAssembly;
@@ -33,9 +49,36 @@ namespace Graphics {
         vk::PipelineDynamicStateCreateInfo _dynamic;
         vk::PipelineLayout _layout;
         std::vector<vk::PipelineShaderStageCreateInfo> _shaderStages;
-    };
 
+        // What the create infos above pointed to when they were set.
+        std::vector<vk::VertexInputBindingDescription> _vertexBindings;
+        std::vector<vk::VertexInputAttributeDescription> _vertexAttributes;
+        std::vector<vk::PipelineColorBlendAttachmentState> _blendAttachments;
+        std::vector<vk::DynamicState> _dynamicStates;
+        std::vector<vk::Viewport> _viewports;
+        std::vector<vk::Rect2D> _scissors;
+        std::vector<std::string> _entryPoints;
 
+        // Each shader stage's specialization constants, empty if it has none.
+        struct Specialization {
+            std::vector<vk::SpecializationMapEntry> entries;
+            std::vector<uint8_t> data;
+        };
+        std::vector<Specialization> _specializations;
+    };
 
+    /**
+     * A material's pipelines being compiled on the worker pool, one task per vertex
+     * format. The engine publishes them into the material once both are done.
+     */
+    struct PipelineJob {
+        std::string name;
+        Material *material = nullptr;
 
-}
\ No newline at end of file
+        // Indexed by VertexFormat.
+        PipelineBuilder builders[2];
+        vk::Pipeline pipelines[2];
+        vk::Result results[2] = {vk::Result::eIncomplete, vk::Result::eIncomplete};
+        std::atomic<int> remaining {2};
+    };
+}
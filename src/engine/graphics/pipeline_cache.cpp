@@ -0,0 +1,74 @@
+#include "pipeline_cache.h"
+#include "atomic_file.h"
+#include "mapped_file.h"
+#include "logging.h"
+#include <cstring>
+#include <vector>
+
+namespace Graphics {
+
+    // VkPipelineCacheHeaderVersionOne, which every cache's data starts with.
+    struct PipelineCacheHeader {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    // Drivers are supposed to reject foreign data themselves, not all of them do.
+    static bool IsCompatible(const uint8_t *data, size_t size, const vk::PhysicalDeviceProperties &properties) {
+        if (size < sizeof(PipelineCacheHeader)) return false;
+
+        PipelineCacheHeader header;
+        memcpy(&header, data, sizeof(header));
+
+        return header.headerSize >= sizeof(PipelineCacheHeader) &&
+               header.headerSize <= size &&
+               header.headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+               header.vendorID == properties.vendorID &&
+               header.deviceID == properties.deviceID &&
+               memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+    }
+
+    vk::PipelineCache LoadPipelineCache(vk::Device device, const vk::PhysicalDeviceProperties &properties, const std::string &path) {
+        IO::MappedFile file;
+        vk::PipelineCacheCreateInfo cacheInfo {};
+
+        if (!path.empty() && file.Open(path)) {
+            if (IsCompatible(file.Data(), file.Size(), properties)) {
+                cacheInfo.initialDataSize = file.Size();
+                cacheInfo.pInitialData = file.Data();
+            } else {
+                LOGI("Pipeline cache {} is from another device or driver, starting over", path);
+            }
+        }
+
+        auto [result, cache] = device.createPipelineCache(cacheInfo);
+        if (result != vk::Result::eSuccess && cacheInfo.pInitialData) {
+            // Valid header, bad contents. Not worth failing over.
+            LOGW("Pipeline cache {} was rejected, starting over", path);
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            std::tie(result, cache) = device.createPipelineCache(cacheInfo);
+        }
+        VK_CHECK(result);
+
+        if (cacheInfo.pInitialData) {
+            LOGI("Loaded pipeline cache {}, {} bytes", path, cacheInfo.initialDataSize);
+        }
+        return cache;
+    }
+
+    bool SavePipelineCache(vk::Device device, vk::PipelineCache cache, const std::string &path) {
+        if (path.empty()) return false;
+
+        auto [result, data] = device.getPipelineCacheData(cache);
+        if (result != vk::Result::eSuccess || data.empty()) return false;
+
+        if (!IO::WriteFileAtomic(path, {{data.data(), data.size()}})) return false;
+
+        LOGI("Wrote pipeline cache {}, {} bytes", path, data.size());
+        return true;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "vulkan.h"
+#include <string>
+
+namespace Graphics {
+
+    /**
+     * Create a pipeline cache seeded from path. Data written for another device,
+     * driver or cache layout is ignored and the cache starts out empty.
+     */
+    vk::PipelineCache LoadPipelineCache(vk::Device device, const vk::PhysicalDeviceProperties &properties, const std::string &path);
+
+    /**
+     * Write cache's contents to path for LoadPipelineCache to pick up next run.
+     */
+    bool SavePipelineCache(vk::Device device, vk::PipelineCache cache, const std::string &path);
+};
@@ -0,0 +1,75 @@
+#include "pipeline_registry.h"
+
+namespace Graphics {
+
+    void PipelineRegistry::Init(vk::Device device, vk::RenderPass renderPass, vk::PipelineCache cache) {
+        _device = device;
+        _renderPass = renderPass;
+        _cache = cache;
+    }
+
+    void PipelineRegistry::Destroy() {
+        std::lock_guard<std::mutex> lock {_mutex};
+        for (auto &[key, entry] : _entries) {
+            _device.destroyPipeline(entry.pipeline);
+        }
+        _entries.clear();
+        _keys.clear();
+    }
+
+    vk::ResultValue<vk::Pipeline> PipelineRegistry::Acquire(const PipelineBuilder &builder) {
+        std::string key = builder.GetKey();
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            auto it = _entries.find(key);
+            if (it != _entries.end()) {
+                it->second.references++;
+                return {vk::Result::eSuccess, it->second.pipeline};
+            }
+        }
+
+        // Compiling can take a while, other threads keep using the registry meanwhile.
+        auto [result, pipeline] = builder.Build(_device, _renderPass, _cache);
+        if (result != vk::Result::eSuccess) {
+            return {result, pipeline};
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        auto [it, inserted] = _entries.try_emplace(key);
+        if (inserted) {
+            it->second.pipeline = pipeline;
+            _keys[static_cast<VkPipeline>(pipeline)] = key;
+        } else {
+            // Another thread built the same state first, keep theirs.
+            _device.destroyPipeline(pipeline);
+        }
+        it->second.references++;
+        return {vk::Result::eSuccess, it->second.pipeline};
+    }
+
+    void PipelineRegistry::Retain(vk::Pipeline pipeline) {
+        std::lock_guard<std::mutex> lock {_mutex};
+        auto key = _keys.find(static_cast<VkPipeline>(pipeline));
+        if (key == _keys.end()) return;
+
+        _entries[key->second].references++;
+    }
+
+    void PipelineRegistry::Release(vk::Pipeline pipeline) {
+        std::lock_guard<std::mutex> lock {_mutex};
+        auto key = _keys.find(static_cast<VkPipeline>(pipeline));
+        if (key == _keys.end()) return;
+
+        auto it = _entries.find(key->second);
+        if (--it->second.references > 0) return;
+
+        _device.destroyPipeline(it->second.pipeline);
+        _entries.erase(it);
+        _keys.erase(key);
+    }
+
+    size_t PipelineRegistry::GetPipelineCount() {
+        std::lock_guard<std::mutex> lock {_mutex};
+        return _entries.size();
+    }
+}
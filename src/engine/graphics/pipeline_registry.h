@@ -0,0 +1,58 @@
+#pragma once
+
+#include "vulkan.h"
+#include "pipeline.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Graphics {
+
+    /**
+     * Graphics pipelines shared by builder state. Acquiring a builder whose key was
+     * seen before returns the same pipeline and counts the reference, and the pipeline
+     * is destroyed when the last one is released. Safe to use from worker threads.
+     *
+     * Retain and Release ignore pipelines the registry doesn't own, so holders of
+     * either kind can treat them alike.
+     */
+    class PipelineRegistry {
+
+    public:
+        void Init(vk::Device device, vk::RenderPass renderPass, vk::PipelineCache cache);
+
+        /**
+         * Destroy every pipeline, released or not. The device must be idle.
+         */
+        void Destroy();
+
+        vk::ResultValue<vk::Pipeline> Acquire(const PipelineBuilder &builder);
+
+        /**
+         * Another reference to a pipeline Acquire returned.
+         */
+        void Retain(vk::Pipeline pipeline);
+
+        /**
+         * Drop a reference, destroying the pipeline with the last one. The caller makes
+         * sure no frame in flight still uses it.
+         */
+        void Release(vk::Pipeline pipeline);
+
+        size_t GetPipelineCount();
+
+    private:
+        struct Entry {
+            vk::Pipeline pipeline;
+            uint32_t references = 0;
+        };
+
+        vk::Device _device;
+        vk::RenderPass _renderPass;
+        vk::PipelineCache _cache;
+
+        std::mutex _mutex;
+        std::unordered_map<std::string, Entry> _entries;
+        std::unordered_map<VkPipeline, std::string> _keys;
+    };
+}
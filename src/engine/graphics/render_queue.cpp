@@ -0,0 +1,92 @@
+#include "render_queue.h"
+#include "logging.h"
+#include <algorithm>
+#include <utility>
+
+namespace Graphics {
+
+    static constexpr uint64_t ID_BITS = 12;
+    static constexpr uint64_t ID_MASK = (1ull << ID_BITS) - 1;
+    static constexpr uint64_t DEPTH_BITS = 16;
+    static constexpr uint64_t DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+    template<typename Key>
+    static uint64_t Intern(std::unordered_map<Key, uint64_t> &ids, Key key) {
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+
+        // Past the id range everything shares the last id. Replay still compares the
+        // real state, so draws stay correct and only lose some grouping.
+        uint64_t id = std::min<uint64_t>(ids.size(), ID_MASK);
+        if (ids.size() == ID_MASK) {
+            LOGW("Render queue ran out of sort key ids this frame, batching will degrade");
+        }
+        ids.emplace(key, id);
+        return id;
+    }
+
+    void RenderQueue::Clear() {
+        _items.clear();
+        _packets.clear();
+
+        // Streaming, eviction and pipeline publishing replace handles every so often,
+        // keeping ids across frames would leak them until the range runs out.
+        _pipelineIds.clear();
+        _textureIds.clear();
+        _materialIds.clear();
+        _meshIds.clear();
+    }
+
+    void RenderQueue::Push(Material* material, Mesh* mesh, const glm::mat4* matrix, float depth) {
+        uint64_t pipeline = Intern(_pipelineIds, static_cast<VkPipeline>(material->GetPipeline(mesh->format)));
+        uint64_t texture = Intern(_textureIds, static_cast<VkDescriptorSet>(material->textureDescriptor));
+        uint64_t materialId = _mergeMaterials ? 0 : Intern(_materialIds, static_cast<const Material*>(material));
+        uint64_t meshId = Intern(_meshIds, static_cast<const Mesh*>(mesh));
+        uint64_t depthBits = static_cast<uint64_t>(std::clamp(depth, 0.f, 1.f) * DEPTH_MASK);
+
+        uint64_t key = pipeline << (DEPTH_BITS + ID_BITS * 3) |
+                       texture << (DEPTH_BITS + ID_BITS * 2) |
+                       materialId << (DEPTH_BITS + ID_BITS) |
+                       meshId << DEPTH_BITS |
+                       depthBits;
+
+        _packets.push_back({key, static_cast<uint32_t>(_items.size())});
+        _items.push_back({material, mesh, matrix});
+    }
+
+    void RenderQueue::Sort() {
+        size_t count = _packets.size();
+        if (count < 2) return;
+
+        _scratch.resize(count);
+        RenderPacket* src = _packets.data();
+        RenderPacket* dst = _scratch.data();
+
+        // LSD radix sort, one byte per pass. Stable, so equal keys keep submission order.
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            size_t offsets[256] = {};
+            for (size_t i = 0; i < count; i++) {
+                offsets[(src[i].key >> shift) & 0xFF]++;
+            }
+
+            // Every key has the same byte here, the pass wouldn't move anything.
+            if (offsets[(src[0].key >> shift) & 0xFF] == count) continue;
+
+            size_t total = 0;
+            for (size_t &offset : offsets) {
+                size_t bucket = offset;
+                offset = total;
+                total += bucket;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                dst[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+            }
+            std::swap(src, dst);
+        }
+
+        if (src != _packets.data()) {
+            _packets.swap(_scratch);
+        }
+    }
+}
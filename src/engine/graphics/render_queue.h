@@ -0,0 +1,87 @@
+#pragma once
+
+#include "renderable.h"
+#include <glm/mat4x4.hpp>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace Graphics {
+
+    /**
+     * An entity queued for drawing this frame.
+     */
+    struct DrawItem {
+        Material* material;
+        Mesh* mesh;
+        const glm::mat4* matrix;
+    };
+
+    /**
+     * Sort key and the item it belongs to. Key layout from the most significant bit:
+     * pipeline (12) | texture descriptor (12) | material (12) | mesh (12) | depth (16).
+     */
+    struct RenderPacket {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    /**
+     * Counters for the commands recorded replaying a queue.
+     */
+    struct RenderStats {
+        uint32_t pipelineBinds = 0;
+        uint32_t descriptorBinds = 0;
+        uint32_t vertexBufferBinds = 0;
+        uint32_t draws = 0;
+        uint32_t instances = 0;
+
+        // Objects dropped by CPU frustum culling before reaching the queue.
+        uint32_t culled = 0;
+    };
+
+    /**
+     * Orders a frame's draws so state changes are minimized regardless of
+     * submission order. Items are pushed unsorted, Sort radix sorts their keys,
+     * then the queue is read back in key order.
+     */
+    class RenderQueue {
+
+    public:
+        void Clear();
+
+        /**
+         * Queue an item. depth is the normalized view depth in [0, 1], items sharing
+         * all state are drawn front to back.
+         */
+        void Push(Material* material, Mesh* mesh, const glm::mat4* matrix, float depth);
+
+        /**
+         * Leave the material out of the key, so materials sharing a pipeline and
+         * texture set sort by mesh. For bindless textures, where draws can span materials.
+         */
+        void SetMergeMaterials(bool merge) { _mergeMaterials = merge; }
+
+        void Sort();
+
+        size_t Size() const { return _packets.size(); }
+
+        /**
+         * The i-th item in sorted order.
+         */
+        const DrawItem& operator[](size_t i) const { return _items[_packets[i].item]; }
+
+    private:
+        std::vector<DrawItem> _items;
+        std::vector<RenderPacket> _packets;
+        std::vector<RenderPacket> _scratch;
+        bool _mergeMaterials = false;
+
+        // Small ids handed out in first seen order. Keys are only compared within a frame,
+        // so Clear starts over and ids of replaced pipelines and sets are reclaimed.
+        std::unordered_map<VkPipeline, uint64_t> _pipelineIds;
+        std::unordered_map<VkDescriptorSet, uint64_t> _textureIds;
+        std::unordered_map<const Material*, uint64_t> _materialIds;
+        std::unordered_map<const Mesh*, uint64_t> _meshIds;
+    };
+};
@@ -2,27 +2,38 @@
 #include "render_system.h"
 #include "renderable.h"
 #include "transform.h"
+#include "logging.h"
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <math.h>
 #include <assert.h>
+#include <array>
+#include <algorithm>
+#include <tuple>
 
 float currentTime = 0;
 
 namespace Graphics {
+
+    // Below this many batches per slice, secondary command buffers cost more than they save.
+    static constexpr size_t MIN_BATCHES_PER_SLICE = 64;
+
     void RenderSystem::Update(entt::registry &registry, float deltaTime) {
         auto view = registry.view<Transform, Renderable>();
         Perframe* perframe = _engine.currentPerframe;
 
+        const float zNear = 0.1f;
+        const float zFar = 200.f;
+
         auto [width, height] = _engine.GetWindowSize();
         glm::vec3 cameraPos {0.f, 0.f, -10.f};
         glm::mat4 viewMatrix = glm::translate(glm::mat4{1.f}, cameraPos);
         glm::mat4 projection = glm::perspective(
             glm::radians(70.f), 
             (float)width / (float)height,
-            0.1f,
-            200.f
+            zNear,
+            zFar
         );
         projection[1][1] *= -1;
 
@@ -31,81 +42,415 @@ namespace Graphics {
         camData.view = viewMatrix;
         camData.viewProj = projection * viewMatrix;
 
-        GPUSceneData sceneData;
+        // Lighting and fog only show on materials with those variants.
+        GPUSceneData sceneData {};
+        sceneData.fogColor = glm::vec4 {0.5f, 0.55f, 0.6f, 1.f};
+        sceneData.fogDistances = glm::vec4 {20.f, 200.f, 0.f, 0.f};
+        sceneData.sunlightDirection = glm::vec4 {glm::normalize(glm::vec3 {0.3f, -1.f, 0.5f}), 1.f};
+        sceneData.sunlightColor = glm::vec4 {1.f};
+
         float x = (1 + sin(currentTime)) / 2;
         float y = (1 + sin(currentTime + 3)) / 2;
         float z = (1 + sin(currentTime + 7)) / 2;
         sceneData.ambientColor = glm::vec4 {x, y, z, 1};
 
         if (perframe) {
-            vk::CommandBuffer cmd = perframe->primaryCommandBuffer;
-
-            // Map buffers
-            _engine.UploadMemory(perframe->cameraBuffer, &camData, 0, sizeof(GPUCameraData));
-            _engine.UploadMemory(
-                _engine.sceneParamsBuffer,
-                &sceneData,
-                _engine.PadUniformBufferSize(sizeof(GPUSceneData)) * perframe->perframeIndex,
-                sizeof(GPUSceneData)
-            );
+            // Uniforms live in the frame allocator, bound through dynamic offsets in binding order.
+            FrameAllocation camera = _engine.frameAllocator.Push(camData);
+            FrameAllocation scene = _engine.frameAllocator.Push(sceneData);
+            std::array<uint32_t, 2> uniformOffsets = {camera.offset, scene.offset};
 
-            Mesh* lastMesh = nullptr;
-            Material* lastMaterial = nullptr;
-
-            assert(perframe->perframeIndex < UINT_MAX); // Just in case, should never have so many frames
-            uint32_t uniformOffset = static_cast<unsigned int>(_engine.PadUniformBufferSize(sizeof(GPUSceneData)) * perframe->perframeIndex);
-
-            int index = 0;
-            for(auto [entity, transform, obj]: view.each()) {
-                // Bind the per-object data
-                _engine.UploadMemory(perframe->objectBuffer, &transform.matrix, index * sizeof(GPUObjectData), sizeof(GPUObjectData));
-
-                if (obj.material != lastMaterial) {
-                    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, obj.material->pipeline);
-                    lastMaterial = obj.material;
-                    cmd.bindDescriptorSets(
-                        vk::PipelineBindPoint::eGraphics,
-                        obj.material->pipelineLayout,
-                        0, 
-                        { perframe->globalDescriptor },
-                        uniformOffset
-                    );
-                    cmd.bindDescriptorSets(
-                        vk::PipelineBindPoint::eGraphics,
-                        obj.material->pipelineLayout,
-                        1,
-                        perframe->objectDescriptor,
-                        {}
-                    );
-                    cmd.bindDescriptorSets(
-                        vk::PipelineBindPoint::eGraphics,
-                        obj.material->pipelineLayout,
-                        2,
-                        obj.material->textureDescriptor,
-                        {}
-                    );
-                }
+            _stats = {};
 
-                MeshPushConstants mvpMatrix;
-                mvpMatrix.renderMatrix = transform.matrix;
+            // The GPU driven path keeps its objects on the device and culls there.
+            if (_gpuDriven) {
+                DrawCulled(registry, *perframe, camData.viewProj, uniformOffsets);
+            } else {
+                // Drop everything outside the frustum before any sorting, upload or draw work is done for it.
+                _candidates.clear();
+                _spheres.Clear();
+                for(auto [entity, transform, obj]: view.each()) {
+                    _candidates.push_back({obj.material, obj.mesh, &transform.matrix});
+                    _spheres.Push(transform.matrix, obj.mesh->boundingSphere);
+                }
 
-                cmd.pushConstants(
-                    obj.material->pipelineLayout,
-                    vk::ShaderStageFlagBits::eVertex,
-                    0, sizeof(MeshPushConstants), &mvpMatrix
-                );
+                _visible.clear();
+                CullSpheres(ExtractFrustum(camData.viewProj), _spheres, _visible);
+                _stats.culled = static_cast<uint32_t>(_candidates.size() - _visible.size());
 
-                if (obj.mesh != lastMesh) {
-                    vk::DeviceSize offset = 0;
-                    cmd.bindVertexBuffers(0, { obj.mesh->vertexBuffer.buffer }, { offset });
-                    lastMesh = obj.mesh;
+                // Sorting groups entities sharing state, so each mesh/material run becomes one
+                // instanced draw and binds only change between runs.
+                _queue.Clear();
+                for (uint32_t i : _visible) {
+                    const DrawItem &item = _candidates[i];
+                    float depth = -(viewMatrix * (*item.matrix)[3]).z;
+                    _queue.Push(item.material, item.mesh, item.matrix, (depth - zNear) / (zFar - zNear));
                 }
+                _queue.Sort();
 
-                cmd.draw(static_cast<uint32_t>(obj.mesh->vertices.size()), 1, 0, index);
-                index += 1;
+                DrawInstanced(*perframe, uniformOffsets);
             }
 
             currentTime += 0.01f;
         }
     }
-}
\ No newline at end of file
+
+    void RenderSystem::SetGpuDriven(bool gpuDriven) {
+        if (gpuDriven && !_engine.SupportsIndirectFirstInstance()) {
+            LOGW("drawIndirectFirstInstance is not supported, culling on the CPU");
+            gpuDriven = false;
+        }
+        _gpuDriven = gpuDriven;
+
+        // Transform changes aren't tracked while drawing from the CPU.
+        _sceneDirty = true;
+    }
+
+    void RenderSystem::Bind(vk::CommandBuffer cmd, Perframe &perframe, const DrawItem &item, const std::array<uint32_t, 2> &uniformOffsets, BindState &bound, RenderStats &stats) {
+        Material* material = item.material;
+        vk::Pipeline pipeline = material->GetPipeline(item.mesh->format);
+
+        if (pipeline != bound.pipeline) {
+            cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            bound.pipeline = pipeline;
+            stats.pipelineBinds++;
+        }
+
+        // Sets stay bound across pipelines with the same layout, only rebind on layout changes.
+        if (material->pipelineLayout != bound.layout) {
+            std::array<vk::DescriptorSet, 2> sets = {perframe.globalDescriptor, perframe.objectDescriptor};
+            cmd.bindDescriptorSets(
+                vk::PipelineBindPoint::eGraphics,
+                material->pipelineLayout,
+                0, 
+                sets,
+                uniformOffsets
+            );
+            bound.layout = material->pipelineLayout;
+            bound.texture = VK_NULL_HANDLE;
+            bound.mesh = nullptr;
+            stats.descriptorBinds++;
+        }
+
+        if (material->textureDescriptor != bound.texture) {
+            cmd.bindDescriptorSets(
+                vk::PipelineBindPoint::eGraphics,
+                material->pipelineLayout,
+                2,
+                material->textureDescriptor,
+                {}
+            );
+            bound.texture = material->textureDescriptor;
+            stats.descriptorBinds++;
+        }
+
+        if (item.mesh != bound.mesh) {
+            vk::DeviceSize offset = 0;
+            cmd.bindVertexBuffers(0, { item.mesh->vertexBuffer.buffer }, { offset });
+            cmd.bindIndexBuffer(item.mesh->indexBuffer.buffer, 0, item.mesh->indexType);
+
+            // Compact meshes dequantize positions with this, full ones ignore it.
+            MeshPushConstants constants;
+            constants.data = glm::vec4 {0.f};
+            constants.renderMatrix = item.mesh->dequantize;
+            cmd.pushConstants(material->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(MeshPushConstants), &constants);
+            bound.mesh = item.mesh;
+            stats.vertexBufferBinds++;
+        }
+    }
+
+    // With bindless textures the texture index travels with each object, so
+    // materials that differ in nothing else can share a draw.
+    static bool SharesDraw(const DrawItem &a, const DrawItem &b, bool bindless) {
+        if (a.mesh != b.mesh) return false;
+        if (a.material == b.material) return true;
+        return bindless &&
+               a.material->GetPipeline(a.mesh->format) == b.material->GetPipeline(b.mesh->format) &&
+               a.material->pipelineLayout == b.material->pipelineLayout &&
+               a.material->textureDescriptor == b.material->textureDescriptor;
+    }
+
+    void RenderSystem::FindBatches() {
+        bool bindless = _engine.IsBindless();
+
+        _batches.clear();
+        for (size_t i = 0; i < _queue.Size(); i++) {
+            const DrawItem &item = _queue[i];
+            if (i > 0 && item.material == _queue[i - 1].material && item.mesh == _queue[i - 1].mesh) continue;
+
+            _engine.MarkUsed(item.mesh, item.material);
+            if (i == 0 || !SharesDraw(_queue[i - 1], item, bindless)) {
+                _batches.push_back(i);
+            }
+        }
+    }
+
+    void RenderSystem::RecordBatches(vk::CommandBuffer cmd, Perframe &perframe, GPUObjectData* objects, size_t firstBatch, size_t lastBatch,
+                                     const std::array<uint32_t, 2> &uniformOffsets, RenderStats &stats) {
+        BindState bound;
+
+        for (size_t b = firstBatch; b < lastBatch; b++) {
+            // Instances of a batch are contiguous in the object buffer, so the
+            // vertex shader finds its object at gl_InstanceIndex.
+            size_t first = _batches[b];
+            size_t last = b + 1 < _batches.size() ? _batches[b + 1] : _queue.Size();
+            for (size_t i = first; i < last; i++) {
+                objects[i].modelMatrix = *_queue[i].matrix;
+                objects[i].textureIndex = _queue[i].material->GetTextureIndex();
+            }
+
+            const DrawItem &batch = _queue[first];
+            Bind(cmd, perframe, batch, uniformOffsets, bound, stats);
+
+            cmd.drawIndexed(
+                batch.mesh->GetIndexCount(),
+                static_cast<uint32_t>(last - first),
+                0,
+                0,
+                static_cast<uint32_t>(first)
+            );
+            stats.draws++;
+            stats.instances += static_cast<uint32_t>(last - first);
+        }
+    }
+
+    void RenderSystem::DrawInstanced(Perframe &perframe, const std::array<uint32_t, 2> &uniformOffsets) {
+        // The object buffer stays mapped, write straight into it and let Render flush once.
+        // Reserve before anything binds objectDescriptor, growing may replace the buffer.
+        GPUObjectData* objects = _engine.ReserveObjects(perframe, _queue.Size());
+
+        FindBatches();
+
+        // One slot stays free for the GUI.
+        size_t slices = std::min(perframe.secondaryCommandBuffers.size() - 1, _batches.size() / MIN_BATCHES_PER_SLICE);
+
+        if (slices <= 1) {
+            _engine.BeginRenderPass();
+            RecordBatches(perframe.primaryCommandBuffer, perframe, objects, 0, _batches.size(), uniformOffsets, _stats);
+            return;
+        }
+
+        // Contiguous slices of the sorted queue, each recorded into its own secondary
+        // and executed in order, so the draw order matches single threaded recording.
+        _engine.BeginRenderPass(vk::SubpassContents::eSecondaryCommandBuffers);
+
+        _sliceStats.assign(slices, {});
+        _engine.jobs.ParallelFor(slices, [&](size_t slice) {
+            size_t firstBatch = _batches.size() * slice / slices;
+            size_t lastBatch = _batches.size() * (slice + 1) / slices;
+
+            vk::CommandBuffer cmd = _engine.BeginSecondary(perframe, slice);
+            RecordBatches(cmd, perframe, objects, firstBatch, lastBatch, uniformOffsets, _sliceStats[slice]);
+            VK_CHECK(cmd.end());
+        });
+
+        perframe.primaryCommandBuffer.executeCommands(
+            vk::ArrayProxy<const vk::CommandBuffer>(static_cast<uint32_t>(slices), perframe.secondaryCommandBuffers.data())
+        );
+
+        for (const RenderStats &sliceStats : _sliceStats) {
+            _stats.pipelineBinds += sliceStats.pipelineBinds;
+            _stats.descriptorBinds += sliceStats.descriptorBinds;
+            _stats.vertexBufferBinds += sliceStats.vertexBufferBinds;
+            _stats.draws += sliceStats.draws;
+            _stats.instances += sliceStats.instances;
+        }
+    }
+
+    void RenderSystem::TrackScene(entt::registry &registry) {
+        if (_sceneRegistry == &registry) return;
+        assert(_sceneRegistry == nullptr);
+
+        _sceneRegistry = &registry;
+        registry.on_construct<Renderable>().connect<&RenderSystem::OnSceneChanged>(*this);
+        registry.on_update<Renderable>().connect<&RenderSystem::OnSceneChanged>(*this);
+        registry.on_destroy<Renderable>().connect<&RenderSystem::OnSceneChanged>(*this);
+        registry.on_construct<Transform>().connect<&RenderSystem::OnSceneChanged>(*this);
+        registry.on_destroy<Transform>().connect<&RenderSystem::OnSceneChanged>(*this);
+        registry.on_update<Transform>().connect<&RenderSystem::OnTransformChanged>(*this);
+        _sceneDirty = true;
+    }
+
+    void RenderSystem::OnSceneChanged(entt::registry &registry, entt::entity entity) {
+        _sceneDirty = true;
+    }
+
+    void RenderSystem::OnTransformChanged(entt::registry &registry, entt::entity entity) {
+        // A rebuild reads every transform anyway.
+        if (_sceneDirty) return;
+        _movedEntities.push_back(entity);
+    }
+
+    bool RenderSystem::SceneStateChanged() {
+        bool changed = false;
+        for (const SceneRun &run : _sceneRuns) {
+            _engine.MarkUsed(run.mesh, run.material);
+
+            // Streaming, eviction and pipeline publishing change what objects were written with.
+            changed = changed ||
+                      run.material->GetPipeline(run.mesh->format) != run.pipeline ||
+                      run.material->pipelineLayout != run.layout ||
+                      run.material->textureDescriptor != run.texture ||
+                      run.material->GetTextureIndex() != run.textureIndex ||
+                      run.mesh->boundingSphere != run.boundingSphere;
+        }
+        return changed;
+    }
+
+    void RenderSystem::BuildScene(entt::registry &registry) {
+        auto view = registry.view<Transform, Renderable>();
+        bool bindless = _engine.IsBindless();
+
+        _sceneEntities.clear();
+        for (auto entity : view) {
+            _sceneEntities.push_back(entity);
+        }
+
+        // Objects sharing every binding end up next to each other, so batches that
+        // can't be one instanced draw can still go out in one multi-draw.
+        auto drawState = [&](entt::entity entity) {
+            const Renderable &renderable = view.get<Renderable>(entity);
+            return std::make_tuple(
+                renderable.material->GetPipeline(renderable.mesh->format),
+                renderable.material->pipelineLayout,
+                renderable.material->textureDescriptor,
+                renderable.mesh,
+                renderable.material
+            );
+        };
+        std::sort(_sceneEntities.begin(), _sceneEntities.end(), [&](entt::entity a, entt::entity b) {
+            return drawState(a) < drawState(b);
+        });
+
+        _sceneSlots.clear();
+        _sceneObjects.resize(_sceneEntities.size());
+        _sceneBatches.clear();
+        _sceneRuns.clear();
+        for (uint32_t slot = 0; slot < _sceneEntities.size(); slot++) {
+            entt::entity entity = _sceneEntities[slot];
+            const Renderable &renderable = view.get<Renderable>(entity);
+            Material* material = renderable.material;
+            Mesh* mesh = renderable.mesh;
+
+            if (_sceneRuns.empty() || _sceneRuns.back().material != material || _sceneRuns.back().mesh != mesh) {
+                DrawItem item {material, mesh, nullptr};
+                if (_sceneRuns.empty() || !SharesDraw({_sceneRuns.back().material, _sceneRuns.back().mesh, nullptr}, item, bindless)) {
+                    _sceneBatches.push_back({material, mesh, slot});
+                }
+                _sceneRuns.push_back({
+                    material,
+                    mesh,
+                    material->GetPipeline(mesh->format),
+                    material->pipelineLayout,
+                    material->textureDescriptor,
+                    material->GetTextureIndex(),
+                    mesh->boundingSphere
+                });
+            }
+
+            GPUCullObject &object = _sceneObjects[slot];
+            object = {};
+            object.modelMatrix = view.get<Transform>(entity).matrix;
+            object.boundingSphere = mesh->boundingSphere;
+            object.batch = static_cast<uint32_t>(_sceneBatches.size() - 1);
+            object.textureIndex = material->GetTextureIndex();
+            _sceneSlots[entity] = slot;
+        }
+
+        _movedEntities.clear();
+        _sceneDirty = false;
+    }
+
+    void RenderSystem::WriteAllSceneObjects() {
+        _writeSlots.resize(_sceneObjects.size());
+        for (uint32_t slot = 0; slot < _writeSlots.size(); slot++) {
+            _writeSlots[slot] = slot;
+        }
+        _writeObjects = _sceneObjects;
+    }
+
+    // Batches that bind the same state can share one multi-draw. Each mesh has its
+    // own vertex and index buffers, so batches of different meshes never can.
+    static bool SharesBindings(const DrawItem &a, const DrawItem &b) {
+        return a.mesh == b.mesh &&
+               a.material->GetPipeline(a.mesh->format) == b.material->GetPipeline(b.mesh->format) &&
+               a.material->pipelineLayout == b.material->pipelineLayout &&
+               a.material->textureDescriptor == b.material->textureDescriptor;
+    }
+
+    void RenderSystem::DrawCulled(entt::registry &registry, Perframe &perframe, const glm::mat4 &viewProj, const std::array<uint32_t, 2> &uniformOffsets) {
+        vk::CommandBuffer cmd = perframe.primaryCommandBuffer;
+
+        // Per frame work here scales with the material/mesh pairs and the entities that
+        // moved, not with the object count. Everything else stays on the GPU.
+        TrackScene(registry);
+        if (SceneStateChanged() || _sceneDirty) {
+            BuildScene(registry);
+            WriteAllSceneObjects();
+        } else {
+            for (entt::entity entity : _movedEntities) {
+                auto it = _sceneSlots.find(entity);
+                if (it == _sceneSlots.end()) continue;
+
+                GPUCullObject &object = _sceneObjects[it->second];
+                object.modelMatrix = registry.get<Transform>(entity).matrix;
+                _writeSlots.push_back(it->second);
+                _writeObjects.push_back(object);
+            }
+            _movedEntities.clear();
+        }
+
+        // Growing drops what the GPU had, so every object is written again.
+        size_t objectCount = _sceneObjects.size();
+        if (_engine.ReserveSceneObjects(objectCount)) {
+            WriteAllSceneObjects();
+        }
+
+        _engine.RecordSceneWrites(perframe, _writeSlots, _writeObjects);
+        _writeSlots.clear();
+        _writeObjects.clear();
+
+        // One indirect draw per batch, its instances get the batch's slot range. The
+        // culling shader packs the survivors at its start and counts them into instanceCount.
+        vk::DrawIndexedIndirectCommand* draws = _engine.ReserveDrawCommands(perframe, objectCount, _sceneBatches.size());
+        for (size_t b = 0; b < _sceneBatches.size(); b++) {
+            vk::DrawIndexedIndirectCommand &draw = draws[b];
+            draw.indexCount = _sceneBatches[b].mesh->GetIndexCount();
+            draw.instanceCount = 0;
+            draw.firstIndex = 0;
+            draw.vertexOffset = 0;
+            draw.firstInstance = _sceneBatches[b].firstSlot;
+        }
+
+        if (objectCount > 0) {
+            _engine.RecordCulling(perframe, ExtractFrustum(viewProj), static_cast<uint32_t>(objectCount));
+        }
+
+        _engine.BeginRenderPass();
+
+        BindState bound;
+        size_t maxDraws = _engine.GetMaxDrawIndirectCount();
+        for (size_t b = 0; b < _sceneBatches.size();) {
+            DrawItem item {_sceneBatches[b].material, _sceneBatches[b].mesh, nullptr};
+
+            size_t last = b + 1;
+            while (last < _sceneBatches.size() && last - b < maxDraws &&
+                   SharesBindings(item, {_sceneBatches[last].material, _sceneBatches[last].mesh, nullptr})) {
+                last++;
+            }
+
+            Bind(cmd, perframe, item, uniformOffsets, bound, _stats);
+            cmd.drawIndexedIndirect(
+                perframe.drawCommandBuffer.buffer,
+                b * sizeof(vk::DrawIndexedIndirectCommand),
+                static_cast<uint32_t>(last - b),
+                sizeof(vk::DrawIndexedIndirectCommand)
+            );
+            _stats.draws++;
+            b = last;
+        }
+
+        // Instance counts are only known on the GPU, report what was submitted for culling.
+        _stats.instances = static_cast<uint32_t>(objectCount);
+    }
+}
@@ -4,25 +4,129 @@
 #include "renderable.h"
 #include "transform.h"
 #include "graphics.h"
+#include "render_queue.h"
+#include <array>
+#include <unordered_map>
 
 namespace Graphics {
 
     class RenderSystem : EntitySystem {
 
     public:
-        RenderSystem(Engine& engine): _engine{engine} {};
+        RenderSystem(Engine& engine): _engine{engine} {
+            _queue.SetMergeMaterials(engine.IsBindless());
+        };
         void Update(entt::registry &registry, float deltaTime = 0) override;
 
-        Material* CreateMaterial(vk::Pipeline pipeline, vk::PipelineLayout layout, const std::string &name);
+        Material* CreateMaterial(vk::Pipeline pipeline, vk::Pipeline compactPipeline, vk::PipelineLayout layout, const std::string &name);
         Material* GetMaterial(const std::string& name);
         Mesh* GetMesh(const std::string& name);
 
+        /**
+         * Cull on the GPU and draw through indirect commands instead of drawing
+         * every object from the CPU. Stays on the CPU path when the device cannot
+         * start indirect draws at a non-zero instance.
+         *
+         * The GPU keeps its own copy of every object, rewritten only for entities whose
+         * Transform changed through registry.patch or replace. Renderables coming,
+         * going or changing rebuild it, as do changes to what they draw with.
+         */
+        void SetGpuDriven(bool gpuDriven);
+
+        /**
+         * Bind and draw counts recorded by the last Update.
+         */
+        const RenderStats& GetStats() const { return _stats; }
+
     private:
         Engine& _engine;
         std::vector<Renderable> _renderables;
+        std::vector<DrawItem> _candidates;
+        SphereBatch _spheres;
+        std::vector<uint32_t> _visible;
+        RenderQueue _queue;
+        RenderStats _stats;
+        std::vector<size_t> _batches;
+        std::vector<RenderStats> _sliceStats;
+        bool _gpuDriven = false;
+
+        // GPU driven scene. Entities sit in slots sorted by draw state, so each batch
+        // is a range of slots starting at firstSlot.
+        struct SceneBatch {
+            Material* material;
+            Mesh* mesh;
+            uint32_t firstSlot;
+        };
+
+        // What the objects of a material/mesh pair were written with.
+        struct SceneRun {
+            Material* material;
+            Mesh* mesh;
+            vk::Pipeline pipeline;
+            vk::PipelineLayout layout;
+            vk::DescriptorSet texture;
+            uint32_t textureIndex;
+            glm::vec4 boundingSphere;
+        };
+
+        entt::registry* _sceneRegistry = nullptr;
+        bool _sceneDirty = true;
+        std::vector<entt::entity> _sceneEntities;
+        std::unordered_map<entt::entity, uint32_t> _sceneSlots;
+        std::vector<GPUCullObject> _sceneObjects; // By slot, as last written to the GPU
+        std::vector<SceneBatch> _sceneBatches;
+        std::vector<SceneRun> _sceneRuns;
+        std::vector<entt::entity> _movedEntities;
+        std::vector<uint32_t> _writeSlots;
+        std::vector<GPUCullObject> _writeObjects;
         std::unordered_map<std::string, Material> _materials;
         std::unordered_map<std::string, Mesh> _meshes;
 
+        // State bound on a command buffer while replaying the queue.
+        struct BindState {
+            vk::Pipeline pipeline;
+            vk::PipelineLayout layout;
+            vk::DescriptorSet texture;
+            Mesh* mesh = nullptr;
+        };
+
+        void Bind(vk::CommandBuffer cmd, Perframe &perframe, const DrawItem &item, const std::array<uint32_t, 2> &uniformOffsets, BindState &bound, RenderStats &stats);
+
+        /**
+         * Fill _batches with the start of each run in the sorted queue that can be one
+         * instanced draw: a mesh and material, or with bindless textures a mesh and
+         * pipeline. Marks what the queue draws as used.
+         */
+        void FindBatches();
+
+        /**
+         * Write objects and record instanced draws for batches [firstBatch, lastBatch).
+         * Touches no shared state besides its object range, so slices can run in parallel.
+         */
+        void RecordBatches(vk::CommandBuffer cmd, Perframe &perframe, GPUObjectData* objects, size_t firstBatch, size_t lastBatch,
+                           const std::array<uint32_t, 2> &uniformOffsets, RenderStats &stats);
+        void DrawInstanced(Perframe &perframe, const std::array<uint32_t, 2> &uniformOffsets);
+        void DrawCulled(entt::registry &registry, Perframe &perframe, const glm::mat4 &viewProj, const std::array<uint32_t, 2> &uniformOffsets);
+
+        /**
+         * Start listening to the registry's Renderable and Transform changes.
+         */
+        void TrackScene(entt::registry &registry);
+        void OnSceneChanged(entt::registry &registry, entt::entity entity);
+        void OnTransformChanged(entt::registry &registry, entt::entity entity);
+
+        /**
+         * Whether any material/mesh pair draws with other state than its objects were
+         * written with. Marks every pair used, like FindBatches.
+         */
+        bool SceneStateChanged();
+
+        /**
+         * Assign slots, batches and objects for every renderable in the registry.
+         */
+        void BuildScene(entt::registry &registry);
+        void WriteAllSceneObjects();
+
         vk::Result AcquireNextImage(uint32_t *index);
         vk::Result Present(uint32_t index);
         vk::Result DrawFrame(uint32_t index, const std::vector<Renderable> &objects);
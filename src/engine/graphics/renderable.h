@@ -1,16 +1,52 @@
 #pragma once
 
 #include "mesh.h"
+#include "texture.h"
 #include "vulkan.h"
 #include <glm/mat4x4.hpp>
 
 namespace Graphics {
 
+    /**
+     * Features of the engine's shaders a material turns on. They're baked into its
+     * pipelines as specialization constants, in field order from constant_id 0, so
+     * features left off cost nothing in the shader.
+     */
+    struct ShaderVariant {
+        vk::Bool32 fog = VK_FALSE;      // Blend to GPUSceneData::fogColor over fogDistances
+        vk::Bool32 lighting = VK_FALSE; // Ambient plus diffuse sunlight
+    };
+
     // pipeline and layout are 64 bit handles to vulkan driver structures
     struct Material {
         vk::Pipeline pipeline;
         vk::PipelineLayout pipelineLayout;
         vk::DescriptorSet textureDescriptor {VK_NULL_HANDLE};
+        Texture* texture = nullptr;
+
+        // Same material built for CompactVertex input, sharing pipelineLayout.
+        vk::Pipeline compactPipeline {VK_NULL_HANDLE};
+
+        // What the pipelines were specialized with, for materials using the engine's shaders.
+        ShaderVariant variant;
+
+        // Materials from Engine::CreateMaterialAsync draw with the default material's
+        // pipelines and layout while Loading.
+        AssetState state = AssetState::Resident;
+
+        bool IsReady() const { return state == AssetState::Resident; }
+
+        vk::Pipeline GetPipeline(VertexFormat format) const {
+            return format == VertexFormat::Compact ? compactPipeline : pipeline;
+        }
+
+        /**
+         * Bindless slot objects drawn with this material sample. Materials without
+         * a texture get the placeholder's.
+         */
+        uint32_t GetTextureIndex() const {
+            return texture ? texture->bindlessIndex : 0;
+        }
     };
 
     struct Renderable {
@@ -0,0 +1,105 @@
+#include "shader_pack.h"
+#include "blob_file.h"
+#include "logging.h"
+#include <cstring>
+
+namespace Graphics {
+
+    static constexpr char SHADER_PACK_MAGIC[4] = {'O', 'K', 'S', 'P'};
+
+    // Bump whenever the header or the index changes.
+    static constexpr uint32_t SHADER_PACK_VERSION = 1;
+
+    // SPIR-V is read as 32 bit words, straight out of the mapping.
+    static constexpr uint64_t SHADER_PACK_ALIGNMENT = 4;
+
+    static constexpr size_t SHADER_PACK_MAX_NAME = 64;
+
+    // A fixed header, an index of shaderCount ShaderPackIndex entries and then the
+    // SPIR-V. Offsets count from dataOffset.
+    struct ShaderPackHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t shaderCount;
+        uint32_t padding;
+        uint64_t dataOffset;
+        uint64_t dataSize;
+    };
+
+    struct ShaderPackIndex {
+        char name[SHADER_PACK_MAX_NAME]; // Null terminated
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    bool LoadShaderPack(const std::string &path, IO::MappedFile &file, ShaderPackView &view) {
+        if (!file.Open(path)) return false;
+
+        if (file.Size() < sizeof(ShaderPackHeader)) {
+            file.Close();
+            return false;
+        }
+
+        ShaderPackHeader header;
+        memcpy(&header, file.Data(), sizeof(header));
+
+        bool valid = memcmp(header.magic, SHADER_PACK_MAGIC, sizeof(header.magic)) == 0 &&
+                     header.version == SHADER_PACK_VERSION &&
+                     sizeof(ShaderPackHeader) + uint64_t(header.shaderCount) * sizeof(ShaderPackIndex) <= header.dataOffset &&
+                     header.dataOffset % SHADER_PACK_ALIGNMENT == 0 &&
+                     header.dataOffset + header.dataSize <= file.Size();
+
+        std::vector<ShaderPackIndex> index;
+        if (valid) {
+            index.resize(header.shaderCount);
+            memcpy(index.data(), file.Data() + sizeof(ShaderPackHeader), index.size() * sizeof(ShaderPackIndex));
+            for (const ShaderPackIndex &entry : index) {
+                valid = valid && entry.name[SHADER_PACK_MAX_NAME - 1] == '\0' &&
+                        entry.offset % SHADER_PACK_ALIGNMENT == 0 &&
+                        entry.size % sizeof(uint32_t) == 0 &&
+                        entry.offset + entry.size <= header.dataSize;
+            }
+        }
+
+        if (!valid) {
+            LOGE("Shader pack {} is invalid or from another version", path);
+            file.Close();
+            return false;
+        }
+
+        const uint8_t *data = file.Data() + header.dataOffset;
+        view.shaders.clear();
+        for (const ShaderPackIndex &entry : index) {
+            view.shaders[entry.name] = {reinterpret_cast<const uint32_t *>(data + entry.offset), static_cast<size_t>(entry.size)};
+        }
+        return true;
+    }
+
+    bool WriteShaderPack(const std::string &path, const std::vector<std::pair<std::string, std::vector<uint8_t>>> &shaders) {
+        ShaderPackHeader header {};
+        memcpy(header.magic, SHADER_PACK_MAGIC, sizeof(header.magic));
+        header.version = SHADER_PACK_VERSION;
+        header.shaderCount = static_cast<uint32_t>(shaders.size());
+
+        IO::BlobFileWriter blobs {SHADER_PACK_ALIGNMENT};
+        std::vector<ShaderPackIndex> index(shaders.size());
+        for (size_t i = 0; i < shaders.size(); i++) {
+            const std::string &name = shaders[i].first;
+            if (name.size() >= SHADER_PACK_MAX_NAME) {
+                LOGE("Shader name {} is too long for the pack", name);
+                return false;
+            }
+
+            memcpy(index[i].name, name.c_str(), name.size() + 1);
+            index[i].offset = blobs.AddBlob(shaders[i].second.data(), shaders[i].second.size());
+            index[i].size = shaders[i].second.size();
+        }
+        header.dataOffset = blobs.GetDataOffset(sizeof(ShaderPackHeader) + index.size() * sizeof(ShaderPackIndex));
+        header.dataSize = blobs.GetDataSize();
+
+        return blobs.Write(path, {
+            {&header, sizeof(header)},
+            {index.data(), index.size() * sizeof(ShaderPackIndex)}
+        });
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "mapped_file.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Graphics {
+
+    /**
+     * One shader's SPIR-V, pointing into the mapped pack file.
+     */
+    struct ShaderPackEntry {
+        const uint32_t *code = nullptr;
+        size_t size = 0; // Bytes
+    };
+
+    /**
+     * Every shader the build compiled, by name: the source file name, or for
+     * permutations the name they were declared with. Points into the mapped pack.
+     */
+    struct ShaderPackView {
+        std::unordered_map<std::string, ShaderPackEntry> shaders;
+    };
+
+    /**
+     * Map the pack at path and index its shaders. view points into file, which
+     * must outlive it.
+     */
+    bool LoadShaderPack(const std::string &path, IO::MappedFile &file, ShaderPackView &view);
+
+    /**
+     * Write shaders, as name and SPIR-V pairs, into one pack at path.
+     */
+    bool WriteShaderPack(const std::string &path, const std::vector<std::pair<std::string, std::vector<uint8_t>>> &shaders);
+};
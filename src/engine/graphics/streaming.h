@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.h"
+#include "mesh.h"
+#include "texture.h"
+#include <string>
+#include <vector>
+
+namespace Graphics {
+
+    /**
+     * An asset requested through one of Engine's Async calls. A worker decodes it,
+     * then the engine batches its upload on the transfer queue and, once that finishes,
+     * moves it into the handle that was returned, which drew as the placeholder
+     * until then.
+     */
+    struct StreamJob {
+        std::string path;
+
+        // Exactly one of these is set, it's the handle the asset lands in.
+        Mesh *mesh = nullptr;
+        Texture *texture = nullptr;
+        VertexFormat format = VertexFormat::Full;
+
+        // Written by the worker, read by the engine once the job is handed back.
+        // The worker also fills staging, so the main thread only records the copy.
+        bool decoded = false;
+        Mesh decodedMesh;
+        size_t vertexSize = 0;
+        size_t indexSize = 0;
+        vk::Extent3D extent;
+        AllocatedBuffer staging;
+
+        // Textures from a cooked cache come in imageFormat with every level, one
+        // copy per level out of staging. Raw ones only have level 0 and no copies.
+        vk::Format imageFormat = vk::Format::eR8G8B8A8Srgb;
+        std::vector<vk::BufferImageCopy> levelCopies;
+
+        // Upload in flight, done once the transfer timeline reaches batch. staging
+        // belongs to the batch from then on.
+        AllocatedBuffer vertexBuffer;
+        AllocatedBuffer indexBuffer;
+        AllocatedImage image;
+        uint64_t batch = 0;
+    };
+};
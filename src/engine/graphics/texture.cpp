@@ -1,15 +1,31 @@
 #include <iostream>
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "texture.h"
+#include "texture_cache.h"
 #include "logging.h"
 #include "graphics.h"
 
 namespace Graphics::Util {
 
     bool LoadImageFromFile(Engine &engine, const char * file, AllocatedImage &outImage) {
+        // A cooked cache has every level ready, skipping both decoding and mip generation.
+        IO::MappedFile cacheFile;
+        TextureCacheView cached;
+        if (LoadTextureCache(file, cacheFile, cached) && engine.CanSampleFormat(cached.format)) {
+            outImage = engine.CreateImage(
+                cached.format,
+                cached.extent,
+                vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+                static_cast<uint32_t>(cached.levels.size())
+            );
+            engine.UploadImageLevels(outImage, cached.data, cached.size, GetTextureCacheCopies(cached, 0));
+            return true;
+        }
+
         int width, height, channels;
 
         stbi_uc* pixels = stbi_load(file, &width, &height, &channels, STBI_rgb_alpha);
@@ -22,7 +38,12 @@ namespace Graphics::Util {
         vk::Format imageFormat = vk::Format::eR8G8B8A8Srgb;
         vk::Extent3D imageExtent {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
 
-        AllocatedImage image = engine.CreateImage(imageFormat, imageExtent, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+        AllocatedImage image = engine.CreateImage(
+            imageFormat,
+            imageExtent,
+            vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+            MipLevelCount(imageExtent)
+        );
         engine.UploadImage(image, pixels);
 
         outImage = image;
@@ -30,4 +51,31 @@ namespace Graphics::Util {
         stbi_image_free(pixels);
         return true;
     }
+
+    bool DecodeImageFile(const char * file, std::vector<uint8_t> &pixels, vk::Extent3D &extent) {
+        int width, height, channels;
+
+        stbi_uc* decoded = stbi_load(file, &width, &height, &channels, STBI_rgb_alpha);
+
+        if (!decoded) {
+            LOGW("Failed to load texture {}", file);
+            return false;
+        }
+
+        extent = vk::Extent3D {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+        pixels.assign(decoded, decoded + size_t(width) * height * 4);
+
+        stbi_image_free(decoded);
+        return true;
+    }
+
+    uint32_t MipLevelCount(vk::Extent3D extent) {
+        uint32_t size = std::max(extent.width, extent.height);
+        uint32_t levels = 1;
+        while (size > 1) {
+            size /= 2;
+            levels++;
+        }
+        return levels;
+    }
 }
\ No newline at end of file
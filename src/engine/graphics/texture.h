@@ -1,6 +1,8 @@
 #pragma once
 
 #include "types.h"
+#include <string>
+#include <vector>
 
 namespace Graphics {
     class Engine;
@@ -10,11 +12,37 @@ namespace Graphics {
          * Load a texture. Remember to delete!
          */
         bool LoadImageFromFile(Engine& engine, const char * file, AllocatedImage& outImage);
+
+        /**
+         * Decode an image file into tightly packed RGBA8 pixels. Touches no
+         * Vulkan state, so it is safe to call from any thread.
+         */
+        bool DecodeImageFile(const char * file, std::vector<uint8_t>& pixels, vk::Extent3D& extent);
+
+        /**
+         * Number of levels in a full mip chain for extent, down to 1x1.
+         */
+        uint32_t MipLevelCount(vk::Extent3D extent);
     }
 
+    struct Material;
+
     struct Texture {
         AllocatedImage image;
         vk::ImageView imageView;
         vk::Sampler sampler;
+        AssetState state = AssetState::Resident;
+
+        // Slot in the engine's bindless texture array. Textures that aren't resident
+        // share the placeholder's slot like they share its image.
+        uint32_t bindlessIndex = 0;
+
+        // File the texture was loaded from, empty for textures that are never evicted.
+        std::string sourcePath;
+        uint64_t lastUsedFrame = 0;
+
+        // Descriptor sets written for materials bound to the texture, rewritten
+        // into fresh sets whenever the image behind it changes.
+        std::vector<std::pair<Material*, vk::DescriptorSet>> bindings;
     };
 };
\ No newline at end of file
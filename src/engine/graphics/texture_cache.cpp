@@ -0,0 +1,141 @@
+#include "texture_cache.h"
+#include "blob_file.h"
+#include "file_stamp.h"
+#include "logging.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Graphics {
+
+    static constexpr char TEXTURE_CACHE_MAGIC[4] = {'O', 'K', 'T', 'X'};
+
+    // Bump whenever the header or the cooking changes.
+    static constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+    // Level data starts are aligned to this, the largest block size of any format cached.
+    static constexpr uint64_t TEXTURE_CACHE_ALIGNMENT = 16;
+
+    static constexpr uint32_t TEXTURE_CACHE_MAX_LEVELS = 16;
+
+    // Laid out like KTX2: a fixed header, an index of levelCount TextureCacheLevels
+    // and then the levels. Level offsets count from dataOffset.
+    struct TextureCacheHeader {
+        char magic[4];
+        uint32_t version;
+
+        // Source file the cache was built from, a mismatch means it is stale.
+        uint64_t sourceSize;
+        int64_t sourceTime;
+
+        uint32_t vkFormat;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+
+        uint64_t dataOffset;
+        uint64_t dataSize;
+    };
+
+    std::string GetTextureCachePath(const std::string &sourcePath) {
+        return sourcePath + ".texcache";
+    }
+
+    bool LoadTextureCache(const std::string &sourcePath, IO::MappedFile &file, TextureCacheView &view) {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!IO::GetFileStamp(sourcePath, sourceSize, sourceTime)) return false;
+
+        std::string cachePath = GetTextureCachePath(sourcePath);
+        if (!file.Open(cachePath)) return false;
+
+        if (file.Size() < sizeof(TextureCacheHeader)) {
+            file.Close();
+            return false;
+        }
+
+        TextureCacheHeader header;
+        memcpy(&header, file.Data(), sizeof(header));
+
+        bool valid = memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                     header.version == TEXTURE_CACHE_VERSION &&
+                     header.sourceSize == sourceSize &&
+                     header.sourceTime == sourceTime &&
+                     header.levelCount > 0 &&
+                     header.levelCount <= TEXTURE_CACHE_MAX_LEVELS &&
+                     sizeof(TextureCacheHeader) + header.levelCount * sizeof(TextureCacheLevel) <= header.dataOffset &&
+                     header.dataOffset + header.dataSize <= file.Size();
+
+        if (valid) {
+            view.levels.resize(header.levelCount);
+            memcpy(view.levels.data(), file.Data() + sizeof(TextureCacheHeader), header.levelCount * sizeof(TextureCacheLevel));
+            for (const TextureCacheLevel &level : view.levels) {
+                valid = valid && level.offset % TEXTURE_CACHE_ALIGNMENT == 0 && level.offset + level.size <= header.dataSize;
+            }
+        }
+
+        if (!valid) {
+            LOGI("Texture cache {} is stale, loading {}", cachePath, sourcePath);
+            view.levels.clear();
+            file.Close();
+            return false;
+        }
+
+        view.format = static_cast<vk::Format>(header.vkFormat);
+        view.extent = vk::Extent3D {header.width, header.height, 1};
+        view.data = file.Data() + header.dataOffset;
+        view.size = static_cast<size_t>(header.dataSize);
+        return true;
+    }
+
+    bool WriteTextureCache(const std::string &sourcePath, vk::Format format, vk::Extent3D extent, const std::vector<std::vector<uint8_t>> &levels) {
+        if (levels.empty() || levels.size() > TEXTURE_CACHE_MAX_LEVELS) return false;
+
+        TextureCacheHeader header {};
+        if (!IO::GetFileStamp(sourcePath, header.sourceSize, header.sourceTime)) return false;
+
+        memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = TEXTURE_CACHE_VERSION;
+        header.vkFormat = static_cast<uint32_t>(format);
+        header.width = extent.width;
+        header.height = extent.height;
+        header.levelCount = static_cast<uint32_t>(levels.size());
+
+        IO::BlobFileWriter blobs {TEXTURE_CACHE_ALIGNMENT};
+        std::vector<TextureCacheLevel> index(levels.size());
+        for (size_t i = 0; i < levels.size(); i++) {
+            index[i] = {blobs.AddBlob(levels[i].data(), levels[i].size()), levels[i].size()};
+        }
+        header.dataOffset = blobs.GetDataOffset(sizeof(TextureCacheHeader) + index.size() * sizeof(TextureCacheLevel));
+        header.dataSize = blobs.GetDataSize();
+
+        std::string cachePath = GetTextureCachePath(sourcePath);
+        bool written = blobs.Write(cachePath, {
+            {&header, sizeof(header)},
+            {index.data(), index.size() * sizeof(TextureCacheLevel)}
+        });
+        if (!written) return false;
+
+        LOGI("Wrote texture cache {}", cachePath);
+        return true;
+    }
+
+    std::vector<vk::BufferImageCopy> GetTextureCacheCopies(const TextureCacheView &view, vk::DeviceSize bufferOffset) {
+        std::vector<vk::BufferImageCopy> copies;
+        for (uint32_t level = 0; level < view.levels.size(); level++) {
+            vk::Extent3D extent {
+                std::max(view.extent.width >> level, 1u),
+                std::max(view.extent.height >> level, 1u),
+                1
+            };
+            copies.push_back({
+                bufferOffset + view.levels[level].offset,
+                0,
+                0,
+                {vk::ImageAspectFlagBits::eColor, level, 0, 1},
+                {},
+                extent
+            });
+        }
+        return copies;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+#include "mapped_file.h"
+#include <string>
+#include <vector>
+
+namespace Graphics {
+
+    /**
+     * One mip level of a cached texture, as a byte range of TextureCacheView::data.
+     */
+    struct TextureCacheLevel {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /**
+     * A cached texture ready for upload, every level already in format and in the
+     * layout vkCmdCopyBufferToImage expects. data points into the mapped cache file.
+     */
+    struct TextureCacheView {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent3D extent;
+        std::vector<TextureCacheLevel> levels;
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+    };
+
+    /**
+     * Path of the cache file for the image at sourcePath.
+     */
+    std::string GetTextureCachePath(const std::string &sourcePath);
+
+    /**
+     * Map the cache for sourcePath if it exists, matches the current cache version
+     * and was written from the source file as it is now (size and modification time).
+     * view points into file, which must outlive it.
+     */
+    bool LoadTextureCache(const std::string &sourcePath, IO::MappedFile &file, TextureCacheView &view);
+
+    /**
+     * Write levels, largest first, as the cache for the image at sourcePath.
+     */
+    bool WriteTextureCache(const std::string &sourcePath, vk::Format format, vk::Extent3D extent, const std::vector<std::vector<uint8_t>> &levels);
+
+    /**
+     * Copies of every level in view from a buffer holding view.data at bufferOffset.
+     */
+    std::vector<vk::BufferImageCopy> GetTextureCacheCopies(const TextureCacheView &view, vk::DeviceSize bufferOffset);
+};
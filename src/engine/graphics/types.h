@@ -2,10 +2,22 @@
 
 #include "vulkan.h"
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
 
 namespace Graphics {
 
+    /**
+     * Where an asset created through one of the Engine's Async calls is. Until it
+     * is Resident the handle shares the placeholder's GPU resources.
+     */
+    enum class AssetState {
+        Loading,
+        Resident,
+        Failed,
+        Evicted // Unloaded to stay within the memory budget, streams back in when drawn
+    };
+
     struct AllocatedBuffer {
         vk::Buffer buffer;
         vma::Allocation allocation;
@@ -16,6 +28,7 @@ namespace Graphics {
         vk::Image image;
         vk::Format format;
         vk::Extent3D extent;
+        uint32_t mipLevels = 1;
         vma::Allocation allocation;
         vma::AllocationInfo allocInfo;
     };
@@ -36,5 +49,27 @@ namespace Graphics {
 
     struct GPUObjectData {
         glm::mat4 modelMatrix;
+        uint32_t textureIndex; // Slot in the bindless texture array
+        uint32_t padding[3];
+    };
+
+    // Input to the culling compute shader, one per object (std430).
+    struct GPUCullObject {
+        glm::mat4 modelMatrix;
+        glm::vec4 boundingSphere; // Object space, xyz = center, w = radius
+        uint32_t batch; // Draw command this object is counted into
+        uint32_t textureIndex;
+        uint32_t padding[2];
+    };
+
+    struct GPUCullConstants {
+        glm::vec4 planes[6];
+        uint32_t objectCount;
+    };
+
+    struct GPUMipConstants {
+        glm::ivec2 srcSize;
+        glm::ivec2 dstSize;
+        uint32_t srgb;
     };
 };
\ No newline at end of file
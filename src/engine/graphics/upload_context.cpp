@@ -4,53 +4,251 @@
 
 namespace Graphics {
 
-    void UploadContext::Init(vk::Device device, uint32_t queueIndex) {
+    void UploadContext::Init(vk::Device device, vma::Allocator allocator, vk::Queue queue, uint32_t queueIndex, size_t stagingSize) {
         _device = device;
+        _allocator = allocator;
+        _queue = queue;
 
         vk::Result result;
 
+        // Command buffers are recycled one by one as their batches complete.
         vk::CommandPoolCreateInfo cmdPoolInfo {
             vk::CommandPoolCreateFlagBits::eTransient |
             vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
             queueIndex
         };
 
-        std::tie(result, commandPool) = _device.createCommandPool(cmdPoolInfo);
-
-        // Allocate the single command buffer for the upload pool.
-        vk::CommandBufferAllocateInfo allocInfo {};
-        allocInfo.level = vk::CommandBufferLevel::ePrimary;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        std::vector<vk::CommandBuffer> cmds;
-        std::tie(result, cmds) = _device.allocateCommandBuffers(allocInfo);
+        std::tie(result, _commandPool) = _device.createCommandPool(cmdPoolInfo);
         VK_CHECK(result);
-        cmd = cmds[0];
 
-        std::tie(result, fence) = _device.createFence({});
+        vk::SemaphoreTypeCreateInfo timelineInfo {vk::SemaphoreType::eTimeline, 0};
+        vk::SemaphoreCreateInfo semaphoreInfo {};
+        semaphoreInfo.pNext = &timelineInfo;
+        std::tie(result, _timeline) = _device.createSemaphore(semaphoreInfo);
         VK_CHECK(result);
+
+        _ringSize = stagingSize;
+        if (_ringSize > 0) {
+            vk::BufferCreateInfo bufferCreateInfo {};
+            bufferCreateInfo.size = _ringSize;
+            bufferCreateInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+            bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+            vma::AllocationCreateInfo allocationCreateInfo {};
+            allocationCreateInfo.flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite |
+                                         vma::AllocationCreateFlagBits::eMapped;
+            allocationCreateInfo.usage = vma::MemoryUsage::eAuto;
+
+            VK_CHECK(_allocator.createBuffer(&bufferCreateInfo, &allocationCreateInfo, &_ring.buffer, &_ring.allocation, &_ring.allocInfo));
+        }
+
+        _head = 0;
+        _tail = 0;
+        _recordingStart = 0;
+        _nextValue = 1;
     }
 
     void UploadContext::Destroy() {
-        _device.destroyFence(fence);
-        _device.freeCommandBuffers(commandPool, cmd);
-        _device.destroyCommandPool(commandPool);
+        // The device is idle by now, every batch is done with its buffers.
+        for (Batch &batch : _inFlight) {
+            for (AllocatedBuffer &buffer : batch.buffers) {
+                _allocator.destroyBuffer(buffer.buffer, buffer.allocation);
+            }
+            for (auto &release : batch.releases) {
+                release();
+            }
+        }
+        _inFlight.clear();
+
+        for (AllocatedBuffer &buffer : _recording.buffers) {
+            _allocator.destroyBuffer(buffer.buffer, buffer.allocation);
+        }
+        for (auto &release : _recording.releases) {
+            release();
+        }
+        _recording = {};
+
+        _allocator.destroyBuffer(_ring.buffer, _ring.allocation);
+        _ring = {};
+
+        _freeCommandBuffers.clear();
+        _device.destroySemaphore(_timeline);
+        _device.destroyCommandPool(_commandPool);
+        _commandPool = nullptr;
     }
 
-    void UploadContext::Begin() {
+    vk::CommandBuffer UploadContext::GetCommandBuffer() {
+        if (_recording.cmd) return _recording.cmd;
+
+        Retire();
+
+        vk::CommandBuffer cmd;
+        if (!_freeCommandBuffers.empty()) {
+            cmd = _freeCommandBuffers.back();
+            _freeCommandBuffers.pop_back();
+        } else {
+            vk::Result result;
+            std::vector<vk::CommandBuffer> cmds;
+            std::tie(result, cmds) = _device.allocateCommandBuffers({_commandPool, vk::CommandBufferLevel::ePrimary, 1});
+            VK_CHECK(result);
+            cmd = cmds[0];
+        }
+
         VK_CHECK(cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit }));
+        _recording.cmd = cmd;
+        return cmd;
+    }
+
+    StagingAllocation UploadContext::Stage(size_t size, size_t alignment) {
+        if (_ringSize == 0 || size > _ringSize) {
+            AllocatedBuffer buffer;
+
+            vk::BufferCreateInfo bufferCreateInfo {};
+            bufferCreateInfo.size = size;
+            bufferCreateInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+            bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+            vma::AllocationCreateInfo allocationCreateInfo {};
+            allocationCreateInfo.flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite |
+                                         vma::AllocationCreateFlagBits::eMapped;
+            allocationCreateInfo.usage = vma::MemoryUsage::eAuto;
+
+            VK_CHECK(_allocator.createBuffer(&bufferCreateInfo, &allocationCreateInfo, &buffer.buffer, &buffer.allocation, &buffer.allocInfo));
+            Adopt(buffer);
+
+            return {buffer.allocInfo.pMappedData, buffer.buffer, 0};
+        }
+
+        while (true) {
+            // Nothing in use, start over at the beginning so the whole ring is available.
+            if (_tail == _head) {
+                _head = _tail = (_head + _ringSize - 1) / _ringSize * _ringSize;
+                _recordingStart = _head;
+            }
+
+            uint64_t start = (_head + alignment - 1) & ~uint64_t(alignment - 1);
+
+            // Allocations never straddle the end of the buffer, skip to its start instead.
+            if (start % _ringSize + size > _ringSize) {
+                start += _ringSize - start % _ringSize;
+            }
+
+            if (start + size - _tail <= _ringSize) {
+                _head = start + size;
+                vk::DeviceSize offset = start % _ringSize;
+                return {reinterpret_cast<char *>(_ring.allocInfo.pMappedData) + offset, _ring.buffer, offset};
+            }
+
+            // Full. Space only comes back as batches complete, which may include the
+            // one being recorded, so that goes out first.
+            if (_inFlight.empty()) {
+                Submit();
+            }
+            if (_inFlight.empty()) {
+                // Staged without recording anything, nothing can be reading the ring.
+                _tail = _head;
+                continue;
+            }
+            Wait(_inFlight.front().value);
+        }
     }
 
-    void UploadContext::SubmitSync(vk::Queue queue) {
-        vk::SubmitInfo submitInfo { };
-        submitInfo.setCommandBuffers(cmd);
+    void UploadContext::Adopt(AllocatedBuffer buffer) {
+        _recording.buffers.push_back(buffer);
+    }
+
+    void UploadContext::Defer(std::function<void()> release) {
+        _recording.releases.push_back(std::move(release));
+    }
+
+    uint64_t UploadContext::Submit() {
+        if (!_recording.cmd) {
+            // Nothing recorded, so nothing can reference these.
+            for (AllocatedBuffer &buffer : _recording.buffers) {
+                _allocator.destroyBuffer(buffer.buffer, buffer.allocation);
+            }
+            for (auto &release : _recording.releases) {
+                release();
+            }
+            _recording.buffers.clear();
+            _recording.releases.clear();
+            return _nextValue - 1;
+        }
+
+        VK_CHECK(_recording.cmd.end());
+        FlushRing(_recordingStart, _head);
+
+        uint64_t value = _nextValue++;
+
+        vk::TimelineSemaphoreSubmitInfo timelineInfo {};
+        timelineInfo.setSignalSemaphoreValues(value);
+
+        vk::SubmitInfo submitInfo {};
+        submitInfo.setCommandBuffers(_recording.cmd);
+        submitInfo.setSignalSemaphores(_timeline);
+        submitInfo.pNext = &timelineInfo;
+        VK_CHECK(_queue.submit(submitInfo, {}));
+
+        _recording.value = value;
+        _recording.ringEnd = _head;
+        _inFlight.push_back(std::move(_recording));
+
+        _recording = {};
+        _recordingStart = _head;
+        return value;
+    }
+
+    bool UploadContext::IsComplete(uint64_t value) {
+        auto [result, completed] = _device.getSemaphoreCounterValue(_timeline);
+        VK_CHECK(result);
+        return completed >= value;
+    }
+
+    void UploadContext::Wait(uint64_t value) {
+        if (value >= _nextValue) {
+            Submit();
+        }
+
+        vk::SemaphoreWaitInfo waitInfo {};
+        waitInfo.setSemaphores(_timeline);
+        waitInfo.setValues(value);
+        VK_CHECK(_device.waitSemaphores(waitInfo, UINT64_MAX));
+
+        Retire();
+    }
+
+    void UploadContext::Retire() {
+        if (_inFlight.empty()) return;
+
+        auto [result, completed] = _device.getSemaphoreCounterValue(_timeline);
+        VK_CHECK(result);
+
+        // Batches on one queue complete in submission order.
+        while (!_inFlight.empty() && _inFlight.front().value <= completed) {
+            Batch &batch = _inFlight.front();
+            for (AllocatedBuffer &buffer : batch.buffers) {
+                _allocator.destroyBuffer(buffer.buffer, buffer.allocation);
+            }
+            for (auto &release : batch.releases) {
+                release();
+            }
+            VK_CHECK(batch.cmd.reset());
+            _freeCommandBuffers.push_back(batch.cmd);
+            _tail = batch.ringEnd;
+            _inFlight.pop_front();
+        }
+    }
 
-        VK_CHECK(cmd.end());
+    void UploadContext::FlushRing(uint64_t start, uint64_t end) {
+        if (_ringSize == 0 || start == end) return;
 
-        VK_CHECK(queue.submit(submitInfo, fence));
-        VK_CHECK(_device.waitForFences(fence, VK_TRUE, UINT64_MAX));
-        VK_CHECK(_device.resetFences(fence));
-        _device.resetCommandPool(commandPool, {});
+        // No-op on HOST_COHERENT memory. A batch's range wraps around at most once.
+        uint64_t wrap = (start / _ringSize + 1) * _ringSize;
+        if (end <= wrap) {
+            VK_CHECK(_allocator.flushAllocation(_ring.allocation, start % _ringSize, end - start));
+        } else {
+            VK_CHECK(_allocator.flushAllocation(_ring.allocation, start % _ringSize, wrap - start));
+            VK_CHECK(_allocator.flushAllocation(_ring.allocation, 0, end - wrap));
+        }
     }
-}
\ No newline at end of file
+}
@@ -1,22 +1,116 @@
 #pragma once
 
 #include "vulkan.h"
+#include "types.h"
+#include <deque>
+#include <functional>
+#include <vector>
 
 namespace Graphics {
+
+    struct StagingAllocation {
+        // Mapped pointer to write the data through.
+        void *data = nullptr;
+
+        // Buffer and offset to copy from.
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+    };
+
+    /**
+     * Records uploads for one queue into batches. Data is staged in a persistent,
+     * mapped ring buffer, any number of copies share a batch's command buffer and
+     * submission, and each batch signals the next value of a timeline semaphore.
+     * Nothing blocks unless the ring runs full or a caller asks to Wait.
+     */
     class UploadContext {
 
     public:
-        vk::CommandPool commandPool;
-        vk::CommandBuffer cmd;
-        vk::Fence fence;
-        void Init(vk::Device device, uint32_t queueIndex);
-        void Begin();
-        void SubmitSync(vk::Queue queue);
+        /**
+         * stagingSize is the ring size. With 0, or for data larger than the ring,
+         * Stage falls back to a buffer of its own that lives as long as the batch.
+         */
+        void Init(vk::Device device, vma::Allocator allocator, vk::Queue queue, uint32_t queueIndex, size_t stagingSize);
         void Destroy();
 
-        operator bool() { return commandPool; }
+        /**
+         * Command buffer of the batch being recorded, begun on first use.
+         */
+        vk::CommandBuffer GetCommandBuffer();
+
+        /**
+         * Reserve size bytes of staging memory for the batch being recorded. Record
+         * the copy out of it before staging anything else: a full ring submits the
+         * batch being recorded to make room.
+         */
+        StagingAllocation Stage(size_t size, size_t alignment = 16);
+
+        /**
+         * Keep buffer alive until the batch being recorded has completed, then destroy it.
+         */
+        void Adopt(AllocatedBuffer buffer);
+
+        /**
+         * Run release once the batch being recorded has completed, for anything
+         * other than a buffer that its commands use.
+         */
+        void Defer(std::function<void()> release);
+
+        /**
+         * Submit the batch being recorded, if anything was recorded. Returns the
+         * timeline value that means everything recorded so far has completed.
+         */
+        uint64_t Submit();
+
+        bool IsComplete(uint64_t value);
+
+        /**
+         * Block until value is reached. Submits first if value is the batch being recorded.
+         */
+        void Wait(uint64_t value);
+
+        vk::Semaphore GetTimeline() const { return _timeline; }
+
+        /**
+         * Value the batch being recorded will signal.
+         */
+        uint64_t GetRecordingValue() const { return _nextValue; }
+
+        operator bool() { return _commandPool; }
 
     private:
+        struct Batch {
+            uint64_t value;
+            vk::CommandBuffer cmd;
+            uint64_t ringEnd;
+            std::vector<AllocatedBuffer> buffers;
+            std::vector<std::function<void()>> releases;
+        };
+
         vk::Device _device;
+        vma::Allocator _allocator;
+        vk::Queue _queue;
+        vk::CommandPool _commandPool;
+        vk::Semaphore _timeline;
+
+        // Ring positions only ever grow, the offset in the buffer is position % _ringSize.
+        AllocatedBuffer _ring;
+        size_t _ringSize = 0;
+        uint64_t _head = 0;
+        uint64_t _tail = 0;
+
+        // Batch being recorded, cmd is null until something is recorded.
+        Batch _recording {};
+        uint64_t _recordingStart = 0;
+        uint64_t _nextValue = 1;
+
+        std::deque<Batch> _inFlight;
+        std::vector<vk::CommandBuffer> _freeCommandBuffers;
+
+        /**
+         * Recycle everything belonging to batches the GPU is done with.
+         */
+        void Retire();
+        void FlushRing(uint64_t start, uint64_t end);
     };
 };
@@ -1,5 +1,6 @@
 #include "gui.h"
 #include "graphics/vulkan.h"
+#include "logging.h"
 
 namespace Gui {
 
@@ -7,15 +8,34 @@ namespace Gui {
     };
 
     void Gui::Render() {
+        if (_engine.IsHeadless()) return;
+
         ImGui::Render();
-        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), _engine.currentPerframe->primaryCommandBuffer);
+
+        Graphics::Perframe* perframe = _engine.currentPerframe;
+
+        // Once the pass was opened for secondaries, draw through the slot kept for the GUI.
+        if (_engine.IsRenderPassSecondary()) {
+            vk::CommandBuffer cmd = _engine.BeginSecondary(*perframe, perframe->secondaryCommandBuffers.size() - 1);
+            ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+            VK_CHECK(cmd.end());
+            perframe->primaryCommandBuffer.executeCommands(cmd);
+            return;
+        }
+
+        _engine.BeginRenderPass();
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), perframe->primaryCommandBuffer);
     }
 
     void Gui::PollEvents(const SDL_Event &event) {
+        if (_engine.IsHeadless()) return;
+
         ImGui_ImplSDL2_ProcessEvent(&event);
     }
 
     void Gui::BeginFrame() {
+        if (_engine.IsHeadless()) return;
+
         ImGui_ImplVulkan_NewFrame();
         ImGui_ImplSDL2_NewFrame(_engine.window);
         ImGui::NewFrame();
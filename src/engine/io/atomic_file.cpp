@@ -0,0 +1,27 @@
+#include "atomic_file.h"
+#include <filesystem>
+#include <fstream>
+
+namespace IO {
+
+    bool WriteFileAtomic(const std::string &path, const std::vector<FilePart> &parts) {
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+
+            for (const FilePart &part : parts) {
+                out.write(static_cast<const char *>(part.data), part.size);
+            }
+            if (!out) return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+}
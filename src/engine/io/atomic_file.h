@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+namespace IO {
+
+    /**
+     * A span of bytes to write, kept by the caller until the write returns.
+     */
+    struct FilePart {
+        const void *data;
+        size_t size;
+    };
+
+    /**
+     * Write parts back to back to path. The file is written next to path and
+     * renamed over it, so readers and crashes never see a torn file.
+     */
+    bool WriteFileAtomic(const std::string &path, const std::vector<FilePart> &parts);
+};
@@ -0,0 +1,32 @@
+#include "blob_file.h"
+
+namespace IO {
+
+    BlobFileWriter::BlobFileWriter(uint64_t alignment) : _alignment{alignment}, _padding(alignment, 0) {}
+
+    uint64_t BlobFileWriter::AddBlob(const void *data, size_t size) {
+        uint64_t offset = Align(_dataSize);
+        _blobs.push_back({data, size});
+        _offsets.push_back(offset);
+        _dataSize = offset + size;
+        return offset;
+    }
+
+    bool BlobFileWriter::Write(const std::string &path, const std::vector<FilePart> &head) const {
+        std::vector<FilePart> parts = head;
+
+        size_t headSize = 0;
+        for (const FilePart &part : head) {
+            headSize += part.size;
+        }
+        parts.push_back({_padding.data(), static_cast<size_t>(GetDataOffset(headSize) - headSize)});
+
+        uint64_t written = 0;
+        for (size_t i = 0; i < _blobs.size(); i++) {
+            parts.push_back({_padding.data(), static_cast<size_t>(_offsets[i] - written)});
+            parts.push_back(_blobs[i]);
+            written = _offsets[i] + _blobs[i].size;
+        }
+        return WriteFileAtomic(path, parts);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "atomic_file.h"
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace IO {
+
+    /**
+     * Lays out a file as a header and an index followed by a data section of
+     * blobs, each blob starting at a multiple of alignment. Blob offsets count
+     * from the start of the data section, which is aligned as well.
+     */
+    class BlobFileWriter {
+
+    public:
+        // alignment must be a power of two.
+        explicit BlobFileWriter(uint64_t alignment);
+
+        /**
+         * Place a blob after the previous one and return its offset in the data section.
+         * data is kept until Write.
+         */
+        uint64_t AddBlob(const void *data, size_t size);
+
+        uint64_t GetDataSize() const { return _dataSize; }
+
+        /**
+         * Where the data section starts after head bytes of header and index.
+         */
+        uint64_t GetDataOffset(size_t headSize) const { return Align(headSize); }
+
+        /**
+         * Write head, padding up to the data section and the blobs through WriteFileAtomic.
+         */
+        bool Write(const std::string &path, const std::vector<FilePart> &head) const;
+
+    private:
+        uint64_t _alignment;
+        uint64_t _dataSize = 0;
+        std::vector<FilePart> _blobs;
+        std::vector<uint64_t> _offsets;
+        std::vector<uint8_t> _padding;
+
+        uint64_t Align(uint64_t offset) const { return (offset + _alignment - 1) & ~(_alignment - 1); }
+    };
+};
@@ -0,0 +1,17 @@
+#include "file_stamp.h"
+#include <filesystem>
+
+namespace IO {
+
+    bool GetFileStamp(const std::string &path, uint64_t &size, int64_t &time) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) return false;
+
+        auto writeTime = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+
+        time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+        return true;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace IO {
+
+    /**
+     * Size and modification time of path. Caches built from a file store its
+     * stamp, a different one means the file changed since.
+     */
+    bool GetFileStamp(const std::string &path, uint64_t &size, int64_t &time);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace IO {
+
+    /**
+     * Read-only memory mapping of a whole file. The mapping lives until
+     * Close or destruction, pointers into Data are invalid after that.
+     */
+    class MappedFile {
+
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile& operator=(MappedFile &&other) noexcept;
+
+        bool Open(const std::string &path);
+        void Close();
+
+        const uint8_t* Data() const { return _data; }
+        size_t Size() const { return _size; }
+
+        operator bool() const { return _data != nullptr; }
+
+    private:
+        const uint8_t *_data = nullptr;
+        size_t _size = 0;
+
+#ifdef _WIN32
+        void *_file = nullptr;
+        void *_mapping = nullptr;
+#endif
+    };
+};
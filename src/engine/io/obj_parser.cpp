@@ -0,0 +1,352 @@
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "logging.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <cstring>
+
+namespace IO {
+
+    // Marks a corner component that wasn't written in the file.
+    static constexpr int32_t MISSING_INDEX = std::numeric_limits<int32_t>::min();
+
+    // Anything smaller and the chunks aren't worth a job of their own.
+    static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    // Exactly representable powers of ten, so common inputs convert with one operation.
+    static constexpr double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static inline bool IsBlank(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    const char* ParseFloat(const char *p, const char *end, float &value) {
+        while (p < end && IsBlank(*p)) p++;
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        // Up to 19 significant digits fit in the mantissa, further ones only move the exponent.
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        bool any = false;
+
+        for (; p < end && IsDigit(*p); p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+            } else {
+                exponent++;
+            }
+        }
+
+        if (p < end && *p == '.') {
+            p++;
+            for (; p < end && IsDigit(*p); p++) {
+                any = true;
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if (!any) return nullptr;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && IsDigit(*q)) {
+                int e = 0;
+                for (; q < end && IsDigit(*q); q++) {
+                    if (e < 10000) e = e * 10 + (*q - '0');
+                }
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (mantissa != 0 && exponent != 0) {
+            if (exponent > 0 && exponent <= 22) {
+                result *= POW10[exponent];
+            } else if (exponent < 0 && exponent >= -22) {
+                result /= POW10[-exponent];
+            } else {
+                result *= std::pow(10.0, exponent);
+            }
+        }
+
+        value = static_cast<float>(negative ? -result : result);
+        return p;
+    }
+
+    static const char* ParseInt(const char *p, const char *end, int32_t &value) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        if (p >= end || !IsDigit(*p)) return nullptr;
+
+        int64_t result = 0;
+        for (; p < end && IsDigit(*p); p++) {
+            if (result < std::numeric_limits<int32_t>::max()) {
+                result = result * 10 + (*p - '0');
+            }
+        }
+        result = std::min<int64_t>(result, std::numeric_limits<int32_t>::max());
+        value = static_cast<int32_t>(negative ? -result : result);
+        return p;
+    }
+
+    // Corner components given as negative (relative) indices, see ObjChunk::relative.
+    enum RelativeBits : uint8_t {
+        RELATIVE_VERTEX = 1,
+        RELATIVE_TEXCOORD = 2,
+        RELATIVE_NORMAL = 4
+    };
+
+    /**
+     * What one chunk of lines parsed to. Positive indices are made zero based right
+     * away. Relative ones depend on how much the chunks before defined, so they are
+     * stored relative to the chunk's first element and flagged in relative.
+     */
+    struct ObjChunk {
+        std::vector<float> positions;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        std::vector<ObjCorner> corners;
+        std::vector<uint8_t> relative;
+        bool failed = false;
+        size_t failedLine = 0;
+    };
+
+    static int32_t ResolveIndex(int32_t index, size_t localCount, uint8_t bit, uint8_t &relative) {
+        if (index > 0) return index - 1;
+        if (index == 0) return MISSING_INDEX;
+        relative |= bit;
+        return static_cast<int32_t>(localCount) + index;
+    }
+
+    static const char* ParseCorner(const char *p, const char *end, const ObjChunk &chunk, ObjCorner &corner, uint8_t &relative) {
+        corner = {MISSING_INDEX, MISSING_INDEX, MISSING_INDEX};
+        relative = 0;
+
+        // v, v/vt, v//vn or v/vt/vn
+        int32_t index;
+        p = ParseInt(p, end, index);
+        if (!p) return nullptr;
+        corner.vertex = ResolveIndex(index, chunk.positions.size() / 3, RELATIVE_VERTEX, relative);
+
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/') {
+                p = ParseInt(p, end, index);
+                if (!p) return nullptr;
+                corner.texcoord = ResolveIndex(index, chunk.texcoords.size() / 2, RELATIVE_TEXCOORD, relative);
+            }
+            if (p < end && *p == '/') {
+                p = ParseInt(p + 1, end, index);
+                if (!p) return nullptr;
+                corner.normal = ResolveIndex(index, chunk.normals.size() / 3, RELATIVE_NORMAL, relative);
+            }
+        }
+        return p;
+    }
+
+    static const char* ParseVector(const char *p, const char *end, float *values, size_t count) {
+        for (size_t i = 0; i < count && p; i++) {
+            p = ParseFloat(p, end, values[i]);
+        }
+        return p;
+    }
+
+    static bool ParseLine(const char *p, const char *end, ObjChunk &chunk, std::vector<ObjCorner> &face, std::vector<uint8_t> &faceRelative) {
+        while (p < end && IsBlank(*p)) p++;
+
+        if (end - p >= 2 && p[0] == 'v' && IsBlank(p[1])) {
+            // Trailing vertex colors, if any, are ignored.
+            float position[3];
+            if (!ParseVector(p + 2, end, position, 3)) return false;
+            chunk.positions.insert(chunk.positions.end(), position, position + 3);
+        } else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2])) {
+            float normal[3];
+            if (!ParseVector(p + 3, end, normal, 3)) return false;
+            chunk.normals.insert(chunk.normals.end(), normal, normal + 3);
+        } else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && IsBlank(p[2])) {
+            float texcoord[2] = {0.f, 0.f};
+            const char *q = ParseFloat(p + 3, end, texcoord[0]);
+            if (!q) return false;
+            ParseFloat(q, end, texcoord[1]);
+            chunk.texcoords.insert(chunk.texcoords.end(), texcoord, texcoord + 2);
+        } else if (end - p >= 2 && p[0] == 'f' && IsBlank(p[1])) {
+            face.clear();
+            faceRelative.clear();
+            const char *q = p + 2;
+            while (true) {
+                while (q < end && (IsBlank(*q) || *q == '\r')) q++;
+                if (q >= end) break;
+
+                ObjCorner corner;
+                uint8_t relative;
+                q = ParseCorner(q, end, chunk, corner, relative);
+                if (!q) return false;
+                face.push_back(corner);
+                faceRelative.push_back(relative);
+            }
+            if (face.size() < 3) return false;
+
+            // Fan triangulation, matching convex polygons as exported by most tools.
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                chunk.corners.insert(chunk.corners.end(), {face[0], face[i], face[i + 1]});
+                chunk.relative.insert(chunk.relative.end(), {faceRelative[0], faceRelative[i], faceRelative[i + 1]});
+            }
+        }
+        // Comments, groups, smoothing and material statements carry nothing we keep.
+
+        return true;
+    }
+
+    static void ParseChunk(const char *begin, const char *end, ObjChunk &chunk) {
+        // A rough guess from typical line lengths saves most of the regrowth.
+        size_t estimatedLines = static_cast<size_t>(end - begin) / 32;
+        chunk.positions.reserve(estimatedLines);
+        chunk.corners.reserve(estimatedLines * 2);
+        chunk.relative.reserve(estimatedLines * 2);
+
+        std::vector<ObjCorner> face;
+        std::vector<uint8_t> faceRelative;
+        size_t line = 0;
+
+        const char *p = begin;
+        while (p < end) {
+            const char *lineEnd = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!lineEnd) lineEnd = end;
+            line++;
+
+            if (!ParseLine(p, lineEnd, chunk, face, faceRelative)) {
+                chunk.failed = true;
+                chunk.failedLine = line;
+                return;
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    static int32_t FixIndex(int32_t index, bool relative, size_t base) {
+        if (index == MISSING_INDEX) return -1;
+        if (relative) return static_cast<int32_t>(base) + index;
+        return index;
+    }
+
+    bool ParseObj(const std::string &path, Jobs::ThreadPool &pool, ObjData &data) {
+        MappedFile file;
+        if (!file.Open(path)) {
+            LOGE("Failed to open {}", path);
+            return false;
+        }
+
+        const char *text = reinterpret_cast<const char *>(file.Data());
+        const char *textEnd = text + file.Size();
+
+        // Split at line starts, with a few chunks per thread so uneven ones balance out.
+        size_t threads = pool.GetThreadCount() + 1;
+        size_t chunkCount = std::max<size_t>(1, std::min(threads * 4, file.Size() / MIN_CHUNK_SIZE));
+        std::vector<const char *> bounds {text};
+        for (size_t i = 1; i < chunkCount; i++) {
+            const char *split = text + file.Size() * i / chunkCount;
+            split = std::max(split, bounds.back());
+            const char *newline = static_cast<const char *>(memchr(split, '\n', static_cast<size_t>(textEnd - split)));
+            if (!newline) break;
+            bounds.push_back(newline + 1);
+        }
+        bounds.push_back(textEnd);
+
+        std::vector<ObjChunk> chunks(bounds.size() - 1);
+        pool.ParallelFor(chunks.size(), [&](size_t i) {
+            ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+        });
+
+        // Where each chunk's elements land in the combined arrays.
+        std::vector<size_t> positionBase(chunks.size()), normalBase(chunks.size()), texcoordBase(chunks.size()), cornerBase(chunks.size());
+        size_t positionCount = 0, normalCount = 0, texcoordCount = 0, cornerCount = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            if (chunks[i].failed) {
+                size_t line = chunks[i].failedLine;
+                for (size_t j = 0; j < i; j++) {
+                    line += static_cast<size_t>(std::count(bounds[j], bounds[j + 1], '\n'));
+                }
+                LOGE("Failed to parse {} at line {}", path, line);
+                return false;
+            }
+
+            positionBase[i] = positionCount;
+            normalBase[i] = normalCount;
+            texcoordBase[i] = texcoordCount;
+            cornerBase[i] = cornerCount;
+            positionCount += chunks[i].positions.size();
+            normalCount += chunks[i].normals.size();
+            texcoordCount += chunks[i].texcoords.size();
+            cornerCount += chunks[i].corners.size();
+        }
+
+        data.positions.resize(positionCount);
+        data.normals.resize(normalCount);
+        data.texcoords.resize(texcoordCount);
+        data.corners.resize(cornerCount);
+
+        std::atomic<bool> valid {true};
+        pool.ParallelFor(chunks.size(), [&](size_t i) {
+            ObjChunk &chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + positionBase[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + normalBase[i]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), data.texcoords.begin() + texcoordBase[i]);
+
+            ObjCorner *out = data.corners.data() + cornerBase[i];
+            for (size_t c = 0; c < chunk.corners.size(); c++) {
+                ObjCorner corner = chunk.corners[c];
+                uint8_t relative = chunk.relative[c];
+                corner.vertex = FixIndex(corner.vertex, relative & RELATIVE_VERTEX, positionBase[i] / 3);
+                corner.normal = FixIndex(corner.normal, relative & RELATIVE_NORMAL, normalBase[i] / 3);
+                corner.texcoord = FixIndex(corner.texcoord, relative & RELATIVE_TEXCOORD, texcoordBase[i] / 2);
+
+                if (corner.vertex < 0 || static_cast<size_t>(corner.vertex) >= positionCount / 3 ||
+                    corner.normal < -1 || static_cast<int64_t>(corner.normal) >= static_cast<int64_t>(normalCount / 3) ||
+                    corner.texcoord < -1 || static_cast<int64_t>(corner.texcoord) >= static_cast<int64_t>(texcoordCount / 2)) {
+                    valid = false;
+                }
+                out[c] = corner;
+            }
+
+            chunk = {};
+        });
+
+        if (!valid) {
+            LOGE("{} references vertex data that doesn't exist", path);
+            return false;
+        }
+
+        return true;
+    }
+}
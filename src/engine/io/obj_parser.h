@@ -0,0 +1,55 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace IO {
+
+    /**
+     * One face corner, as zero based indices into the ObjData arrays. -1 if absent.
+     */
+    struct ObjCorner {
+        int32_t vertex;
+        int32_t normal;
+        int32_t texcoord;
+
+        bool operator==(const ObjCorner &other) const {
+            return vertex == other.vertex && normal == other.normal && texcoord == other.texcoord;
+        }
+    };
+
+    struct ObjCornerHash {
+        size_t operator()(const ObjCorner &corner) const {
+            // Mix the three indices with large odd multipliers, cheaper than hash_combine chains.
+            uint64_t h = static_cast<uint32_t>(corner.vertex) * 0x9E3779B97F4A7C15ull;
+            h ^= static_cast<uint32_t>(corner.normal) * 0xC2B2AE3D27D4EB4Full;
+            h ^= static_cast<uint32_t>(corner.texcoord) * 0x165667B19E3779F9ull;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    /**
+     * Geometry of a whole OBJ file. Shapes, groups and materials are not kept,
+     * every face is fan triangulated into one triangle list.
+     */
+    struct ObjData {
+        std::vector<float> positions; // xyz
+        std::vector<float> normals;   // xyz
+        std::vector<float> texcoords; // uv
+        std::vector<ObjCorner> corners;
+    };
+
+    /**
+     * Parse an OBJ file. The file is memory mapped and split into line aligned
+     * chunks that are parsed on the pool, then stitched together.
+     */
+    bool ParseObj(const std::string &path, Jobs::ThreadPool &pool, ObjData &data);
+
+    /**
+     * Parse a decimal floating point number starting at p, skipping leading blanks.
+     * Returns the first character after it, or nullptr if there is no number.
+     */
+    const char* ParseFloat(const char *p, const char *end, float &value);
+};
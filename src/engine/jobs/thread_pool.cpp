@@ -0,0 +1,93 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace Jobs {
+
+    ThreadPool::ThreadPool(uint32_t threadCount) {
+        if (threadCount == 0) {
+            uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+        }
+
+        _threads.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++) {
+            _threads.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _stopping = true;
+        }
+        _wake.notify_all();
+
+        for (auto &thread : _threads) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _jobs.push_back(std::move(job));
+        }
+        _wake.notify_one();
+    }
+
+    void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &fn) {
+        if (count == 0) return;
+        if (count == 1) {
+            fn(0);
+            return;
+        }
+
+        // Shared between the helpers, which may outlive this call by a few instructions.
+        struct Work {
+            std::atomic<size_t> next {0};
+            std::atomic<size_t> done {0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto work = std::make_shared<Work>();
+
+        // Indices are claimed one at a time, so uneven items still balance out.
+        auto run = [work, count, &fn]() {
+            size_t i;
+            while ((i = work->next.fetch_add(1)) < count) {
+                fn(i);
+                if (work->done.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock {work->mutex};
+                    work->finished.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min<size_t>(_threads.size(), count - 1);
+        for (size_t i = 0; i < helpers; i++) {
+            Submit(run);
+        }
+
+        run();
+
+        std::unique_lock<std::mutex> lock {work->mutex};
+        work->finished.wait(lock, [&]() { return work->done.load() == count; });
+    }
+
+    void ThreadPool::WorkerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock {_mutex};
+                _wake.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+                if (_stopping && _jobs.empty()) return;
+
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job();
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace Jobs {
+
+    /**
+     * Fixed set of worker threads pulling jobs from a shared queue.
+     */
+    class ThreadPool {
+
+    public:
+        /**
+         * Start threadCount workers. 0 picks one less than the hardware thread count,
+         * leaving the calling thread to help out in ParallelFor.
+         */
+        explicit ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        uint32_t GetThreadCount() const { return static_cast<uint32_t>(_threads.size()); }
+
+        /**
+         * Run job on a worker at some point. Jobs must not throw.
+         */
+        void Submit(std::function<void()> job);
+
+        /**
+         * Call fn(i) for every i in [0, count) across the workers and the calling
+         * thread, returning once all calls are done.
+         */
+        void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _jobs;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        bool _stopping = false;
+
+        void WorkerLoop();
+    };
+};
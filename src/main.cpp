@@ -7,6 +7,9 @@
 #include "logging.h"
 #include <entt/entt.hpp>
 #include <string>
+#include <cstring>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <glm/vec3.hpp> // glm::vec3
 #include <glm/ext/matrix_transform.hpp>
@@ -23,6 +26,18 @@ struct Velocity {
 
 float globalvar = 0;
 
+// Write RGBA8 pixels out as a binary PPM, dropping alpha.
+bool WritePPM(const char *path, const std::vector<uint8_t> &pixels, uint32_t width, uint32_t height) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+    for(size_t i = 0; i < pixels.size(); i += 4) {
+        file.write(reinterpret_cast<const char *>(&pixels[i]), 3);
+    }
+    return true;
+}
+
 class GravitySystem {
 public:
     void Update(entt::registry &registry, float deltaTime) {
@@ -44,9 +59,40 @@ int main(int argc, char* args[] ) {
     std::cout << "Running in DEBUG mode" << std::endl;
 #endif
 
+    // --headless          render offscreen without a window
+    // --frames <n>        stop after n frames when headless
+    // --capture <file>    write the last headless frame to a PPM
+    // --frames-in-flight <n>  how many frames the CPU may record ahead of the GPU
+    // --gpu-driven        frustum cull in a compute shader and draw indirectly
+    // --compact-vertices  load OBJ meshes with quantized 20 byte vertices
+    // --worker-threads <n>  threads for parallel command recording, 0 picks from the core count
+    Graphics::EngineConfig config;
+    uint64_t headlessFrames = 1000;
+    bool gpuDriven = false;
+    Graphics::VertexFormat meshFormat = Graphics::VertexFormat::Full;
+    const char *capturePath = nullptr;
+    for(int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (strcmp(args[i], "--frames") == 0 && i + 1 < argc) {
+            headlessFrames = std::stoull(args[++i]);
+        } else if (strcmp(args[i], "--capture") == 0 && i + 1 < argc) {
+            capturePath = args[++i];
+        } else if (strcmp(args[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            config.framesInFlight = static_cast<uint32_t>(std::stoul(args[++i]));
+        } else if (strcmp(args[i], "--worker-threads") == 0 && i + 1 < argc) {
+            config.workerThreads = static_cast<uint32_t>(std::stoul(args[++i]));
+        } else if (strcmp(args[i], "--gpu-driven") == 0) {
+            gpuDriven = true;
+        } else if (strcmp(args[i], "--compact-vertices") == 0) {
+            meshFormat = Graphics::VertexFormat::Compact;
+        }
+    }
+
     bool quit = false;
-    Graphics::Engine graphics;
+    Graphics::Engine graphics {config};
     Graphics::RenderSystem renderSystem {graphics};
+    renderSystem.SetGpuDriven(gpuDriven);
 
     Input input { false };
 
@@ -56,17 +102,18 @@ int main(int argc, char* args[] ) {
     GravitySystem gravitySystem;
 
 
-    Graphics::Mesh* monkeyMesh = graphics.CreateMesh("assets/Monkey/Monkey.obj");
+    // Loaded in the background, entities using these draw the placeholder until they land.
+    Graphics::Mesh* monkeyMesh = graphics.CreateMeshAsync("assets/Monkey/Monkey.obj", meshFormat);
     Graphics::Renderable monkey;
     monkey.mesh = monkeyMesh;
     monkey.material = graphics.GetMaterial("default");
 
-    Graphics::Mesh* lostEmpireMesh = graphics.CreateMesh("assets/lost-empire/lost-empire.obj");
+    Graphics::Mesh* lostEmpireMesh = graphics.CreateMeshAsync("assets/lost-empire/lost-empire.obj", meshFormat);
     Graphics::Renderable lostEmpire;
     lostEmpire.mesh = lostEmpireMesh;
     lostEmpire.material = graphics.GetMaterial("default");
 
-    graphics.CreateTexture("lost-empire", "assets/lost-empire/lost-empire-RGBA.png");
+    graphics.CreateTextureAsync("lost-empire", "assets/lost-empire/lost-empire-RGBA.png");
     graphics.BindTexture(graphics.GetMaterial("default"), "lost-empire");
 
     Primitives::Cube cube { graphics };
@@ -85,8 +132,13 @@ int main(int argc, char* args[] ) {
 
     gui.Init();
 
+    auto startTime = std::chrono::steady_clock::now();
+
     SDL_Event e;
     while (!quit) {
+        if (config.headless && graphics.GetCurrentFrame() >= headlessFrames) {
+            break;
+        }
 
         // Poll events until there are no more events on the event queue.
         while (SDL_PollEvent(&e) != 0) {
@@ -111,17 +163,39 @@ int main(int argc, char* args[] ) {
         gui.Render();
         graphics.Render();
 
-        auto view = registry.view<Transform>();
-
+        // Patched rather than written in place, so GPU driven rendering sees what moved.
         for(auto entity : entities) {
-            Transform& transform = view.get<Transform>(entity);
-            transform.matrix = glm::rotate(transform.matrix, 0.1f, glm::vec3(0.5f, 0.5f, 0.5f));
+            registry.patch<Transform>(entity, [](Transform &transform) {
+                transform.matrix = glm::rotate(transform.matrix, 0.1f, glm::vec3(0.5f, 0.5f, 0.5f));
+            });
         }
 
         input.Reset();
-        SDL_Delay((int)(input.KeyDown ? 0 : 1.f/60.f*1000.f));
+
+        // Run as fast as possible when headless so frame times can be measured.
+        if (!config.headless) {
+            SDL_Delay((int)(input.KeyDown ? 0 : 1.f/60.f*1000.f));
+        }
     }
 
     graphics.WaitIdle();
+
+    if (config.headless) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        uint64_t frames = graphics.GetCurrentFrame();
+        LOGI("Rendered {} frames in {:.2f} ms ({:.3f} ms/frame)", frames, elapsed.count(), frames ? elapsed.count() / frames : 0.0);
+
+        const Graphics::RenderStats &stats = renderSystem.GetStats();
+        LOGI("Last frame: {} pipeline binds, {} descriptor binds, {} vertex buffer binds, {} draws, {} instances, {} culled",
+            stats.pipelineBinds, stats.descriptorBinds, stats.vertexBufferBinds, stats.draws, stats.instances, stats.culled);
+
+        if (capturePath) {
+            std::vector<uint8_t> pixels;
+            auto [width, height] = graphics.GetWindowSize();
+            if (!graphics.CaptureFrame(pixels) || !WritePPM(capturePath, pixels, width, height)) {
+                LOGE("Failed to capture frame to {}", capturePath);
+            }
+        }
+    }
     return 0;
 }